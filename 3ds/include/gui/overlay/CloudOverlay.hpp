@@ -33,11 +33,12 @@
 
 class Button;
 class CloudAccess;
+class PKFilter;
 
 class CloudOverlay : public ReplaceableScreen
 {
 public:
-    CloudOverlay(ReplaceableScreen& screen, CloudAccess& access);
+    CloudOverlay(ReplaceableScreen& screen, CloudAccess& access, std::shared_ptr<PKFilter> filter);
     void drawTop() const override;
     void drawBottom() const override;
     void update(touchPosition* touch) override;
@@ -45,6 +46,7 @@ public:
 private:
     std::vector<std::unique_ptr<Button>> buttons;
     CloudAccess& access;
+    std::shared_ptr<PKFilter> filter;
 };
 
 #endif
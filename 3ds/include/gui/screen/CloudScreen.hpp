@@ -71,6 +71,7 @@ private:
     int storageBox    = 0;
     bool justSwitched = true;
     bool cloudChosen  = false;
+    bool filterEdited = false;
 };
 
 #endif
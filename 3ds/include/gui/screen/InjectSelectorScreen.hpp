@@ -30,7 +30,6 @@
 #include "Hid.hpp"
 #include "Sav.hpp"
 #include "Screen.hpp"
-#include "nlohmann/json_fwd.hpp"
 #include <memory>
 #include <string>
 #include <vector>
@@ -51,8 +50,11 @@ private:
     bool doQR(void);
     bool toggleFilter(const std::string& lang);
     bool toggleFilter(u8 type);
+    void searchBar(void);
+    void filter(void);
     Hid<HidDirection::HORIZONTAL, HidDirection::HORIZONTAL> hid;
-    std::vector<nlohmann::json> wondercards;
+    // Events that pass the filters and the search
+    std::vector<size_t> wondercards;
     std::vector<std::unique_ptr<Button>> buttons;
     std::vector<std::unique_ptr<ToggleButton>> langFilters;
     std::vector<std::unique_ptr<ToggleButton>> typeFilters;
@@ -61,6 +63,7 @@ private:
     void dumpCard(void) const;
     std::vector<Sav::giftData> gifts;
     std::string langFilter = "";
+    std::string searchString;
     int typeFilter         = -1;
     bool dump              = false;
     bool updateGifts       = false;
@@ -31,8 +31,8 @@
 #include "Language.hpp"
 #include "Sav.hpp"
 #include "Screen.hpp"
-#include "nlohmann/json_fwd.hpp"
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -42,7 +42,7 @@ class WCX;
 class InjectorScreen : public Screen
 {
 public:
-    InjectorScreen(nlohmann::json ids);
+    InjectorScreen(size_t event);
     InjectorScreen(std::unique_ptr<WCX> card);
     ~InjectorScreen();
     void update(touchPosition* touch) override;
@@ -58,7 +58,8 @@ private:
     std::unique_ptr<WCX> wondercard;
     std::string game;
     Hid<HidDirection::HORIZONTAL, HidDirection::HORIZONTAL> hid;
-    std::unique_ptr<nlohmann::json> ids;
+    // Gift database event, if the card came from there
+    std::optional<size_t> event;
     const std::vector<Sav::giftData> gifts;
     const int emptySlot;
     int slot;
@@ -161,6 +161,10 @@ Configuration::Configuration()
                 (*mJson)["alphaChannel"] = false;
                 (*mJson)["autoUpdate"]   = true;
             }
+            if ((*mJson)["version"].get<int>() < 9)
+            {
+                (*mJson)["gpssServer"] = "https://flagbrew.org";
+            }
 
             (*mJson)["version"] = CURRENT_VERSION;
             save();
@@ -182,6 +186,7 @@ Configuration::Configuration()
             !(mJson->contains("patronCode") && (*mJson)["patronCode"].is_string()) ||
             !(mJson->contains("alphaChannel") && (*mJson)["alphaChannel"].is_boolean()) ||
             !(mJson->contains("autoUpdate") && (*mJson)["autoUpdate"].is_boolean()) ||
+            !(mJson->contains("gpssServer") && (*mJson)["gpssServer"].is_string()) ||
             !((*mJson)["defaults"].contains("tid") && (*mJson)["defaults"]["tid"].is_number_integer()) ||
             !((*mJson)["defaults"].contains("sid") && (*mJson)["defaults"]["sid"].is_number_integer()) ||
             !((*mJson)["defaults"].contains("ot") && (*mJson)["defaults"]["ot"].is_string()) ||
@@ -429,6 +434,11 @@ bool Configuration::autoUpdate(void) const
     return (*mJson)["autoUpdate"];
 }
 
+std::string Configuration::gpssServer(void) const
+{
+    return (*mJson)["gpssServer"];
+}
+
 void Configuration::language(Language lang)
 {
     (*mJson)["language"] = u8(lang);
@@ -533,3 +543,8 @@ void Configuration::autoUpdate(bool value)
 {
     (*mJson)["autoUpdate"] = value;
 }
+
+void Configuration::gpssServer(const std::string& value)
+{
+    (*mJson)["gpssServer"] = value;
+}
@@ -27,7 +27,10 @@
 #include "app.hpp"
 #include "Button.hpp"
 #include "Configuration.hpp"
+#include "DownloadCounter.hpp"
 #include "FSStream.hpp"
+#include "GPSSStore.hpp"
+#include "GPSSUpload.hpp"
 #include "TitleLoadScreen.hpp"
 #include "appIcon.hpp"
 #include "archive.hpp"
@@ -35,9 +38,11 @@
 #include "fetch.hpp"
 #include "format.h"
 #include "gui.hpp"
+#include "httpcache.hpp"
 #include "i18n.hpp"
 #include "io.hpp"
 #include "loader.hpp"
+#include "mysterygift.hpp"
 #include "nlohmann/json.hpp"
 #include "random.hpp"
 #include "revision.h"
@@ -115,16 +120,9 @@ namespace
         for (auto item : assets)
         {
             bool downloadAsset = true;
-            if (io::exists(item.path))
+            if (io::exists(item.path) && matchSha256HashFromFile(item.path, item.hash))
             {
-                if (matchSha256HashFromFile(item.path, item.hash))
-                {
-                    downloadAsset = false;
-                }
-                else
-                {
-                    std::remove(item.path.c_str());
-                }
+                downloadAsset = false;
             }
             if (downloadAsset)
             {
@@ -134,7 +132,8 @@ namespace
                 if (status == 0)
                     return -1;
 #endif
-                Result res1 = Fetch::download(item.url, item.path);
+                // Replaces the old file only once the new one has been fully downloaded and verified
+                Result res1 = Fetch::download(item.url, item.path, "", nullptr, nullptr, item.hash);
                 if (R_FAILED(res1))
                     return res1;
             }
@@ -628,6 +627,110 @@ namespace
         return ret;
     }
 
+    constexpr std::array<Generation, 4> mgGens = {Generation::FOUR, Generation::FIVE, Generation::SIX, Generation::SEVEN};
+
+    struct GiftFile
+    {
+        enum class State : u8
+        {
+            CHECKING,
+            // Only for data files: getting just the cards that changed, which falls back to DOWNLOADING if it doesn't work out
+            DELTA,
+            DOWNLOADING,
+            DONE
+        };
+
+        std::string fileName;
+        State state = State::CHECKING;
+        // Filled in by the hashing thread
+        std::array<u8, SHA256_BLOCK_SIZE> localChecksum;
+        std::atomic<bool> hashed = false;
+        // Filled in by the Fetch thread. 0 means the request failed, -1 that it's still going
+        std::string remoteChecksum;
+        std::atomic<long> remoteStatus = -1;
+        // The manifest is filled in by the Fetch thread, and deltaResult by the update thread once it's been applied
+        std::string manifest;
+        std::atomic<long> manifestStatus = -1;
+        bool deltaQueued                 = false;
+        std::atomic<int> deltaResult     = -1;
+        // Downloads go through Fetch::download on a thread of their own, so an interrupted one picks up from its .part file next time,
+        // and it only replaces the old file once it matches remoteChecksum
+        std::string url;
+        Result downloadResult        = 0;
+        std::atomic<bool> downloaded = false;
+        bool changed                 = false;
+    };
+
+    struct GiftUpdate
+    {
+        std::string url;
+        // Sheet and data for each of mgGens in turn
+        std::array<GiftFile, mgGens.size() * 2> files;
+        std::array<std::atomic<bool>, mgGens.size()> delta{};
+        std::array<std::atomic<bool>, mgGens.size()> convert{};
+        std::atomic<bool> downloadsDone = false;
+        std::atomic<bool> workerDone    = false;
+    };
+
+    // Hashes the local files while their checksums are being requested, then applies deltas and converts each generation once both of
+    // its files are in. Converting only starts on files that are complete and verified: a resumed download picks up mid-file, and one that
+    // fails its checksum must leave the old database alone. GiftDB::convert decompresses a chunk at a time anyway, so feeding it the
+    // download as it arrives would only save rereading a file that was just written
+    void giftUpdateThread(void* arg)
+    {
+        GiftUpdate* update = (GiftUpdate*)arg;
+
+        for (auto& file : update->files)
+        {
+            file.localChecksum = readGiftChecksum(file.fileName);
+            file.hashed        = true;
+        }
+
+        while (true)
+        {
+            // Read before doing anything, so that every generation flagged before the downloads finished is seen
+            bool done = update->downloadsDone;
+            for (size_t i = 0; i < mgGens.size(); i++)
+            {
+                if (update->delta[i].exchange(false))
+                {
+                    GiftFile& data   = update->files[i * 2 + 1];
+                    data.deltaResult = MysteryGift::applyDelta(mgGens[i], data.manifest, (const u8*)data.remoteChecksum.data(),
+                        update->url + "cards/");
+                }
+                if (update->convert[i].exchange(false))
+                {
+                    MysteryGift::refresh(mgGens[i]);
+                }
+            }
+            if (done)
+            {
+                break;
+            }
+            svcSleepThread(10'000'000);
+        }
+
+        update->workerDone = true;
+    }
+
+    void giftDownloadThread(void* arg)
+    {
+        GiftFile* file       = (GiftFile*)arg;
+        file->downloadResult = Fetch::download(
+            file->url, "/3ds/PKSM/mysterygift/" + file->fileName, "", nullptr, nullptr, (const u8*)file->remoteChecksum.data());
+        file->downloaded = true;
+    }
+
+    void writeGiftChecksum(const std::string& fileName, const u8* checksum)
+    {
+        FILE* f = fopen(("/3ds/PKSM/mysterygift/" + fileName + ".sha").c_str(), "wb");
+        if (f)
+        {
+            fwrite(checksum, 1, SHA256_BLOCK_SIZE, f);
+            fclose(f);
+        }
+    }
+
     void updateGifts(void)
     {
 #if !CITRA_DEBUG
@@ -636,129 +739,172 @@ namespace
         if (status == 0)
             return;
 #endif
-        struct giftCurlData
+        auto update = std::make_unique<GiftUpdate>();
+        // Served from the same place as GPSS, so that pointing that at a local copy of the packer's output covers these too
+        update->url = Configuration::getInstance().gpssServer() + "/static/other/gifts/";
+        for (size_t i = 0; i < mgGens.size(); i++)
         {
-            giftCurlData(FILE* file, std::string fileName) : fileName(fileName), file(file), response(0), prevDownload(0), addedToTotal(false)
+            update->files[i * 2].fileName     = "sheet" + genToString(mgGens[i]) + ".json.bz2";
+            update->files[i * 2 + 1].fileName = "data" + genToString(mgGens[i]) + ".bin.bz2";
+        }
+
+        auto startDownload = [&update](GiftFile& file) {
+            file.url = update->url + file.fileName;
+            if (Threads::create(giftDownloadThread, &file, 16 * 1024))
             {
-                sha256_init(&shaContext);
+                file.state = GiftFile::State::DOWNLOADING;
+                return true;
             }
-            std::string fileName;
-            FILE* file;
-            SHA256_CTX shaContext;
-            long response;
-            u32 prevDownload;
-            bool addedToTotal;
+            file.state = GiftFile::State::DONE;
+            return false;
         };
 
-        curl_write_callback giftWriteFunc = [](char* data, size_t size, size_t nitems, void* out) {
-            giftCurlData* writeMe = (giftCurlData*)out;
+        Gui::waitFrame(i18n::localize("MYSTERY_GIFT_CHECK"));
 
-            if (data)
+        // Every checksum is requested up front, so that checking them all takes about one round trip
+        for (auto& file : update->files)
+        {
+            // Conditional, so an unchanged checksum costs only a 304
+            if (!HttpCache::getAsync(update->url + file.fileName + ".sha", [&file](long status, std::string& body) {
+                    file.remoteChecksum = std::move(body);
+                    file.remoteStatus   = status;
+                }))
             {
-                sha256_update(&writeMe->shaContext, (u8*)data, size * nitems);
-
-                return fwrite(data, size, nitems, writeMe->file);
+                file.remoteStatus = 0;
             }
-            else
+        }
+
+        bool worker = Threads::create(giftUpdateThread, update.get(), 32 * 1024);
+        if (!worker)
+        {
+            for (auto& file : update->files)
             {
-                return size * nitems;
+                file.localChecksum = readGiftChecksum(file.fileName);
+                file.hashed        = true;
             }
-        };
-
-        constexpr std::array<Generation, 4> mgGens = {Generation::FOUR, Generation::FIVE, Generation::SIX, Generation::SEVEN};
-
-        std::atomic<size_t> filesDone = 0;
-        size_t filesToDownload        = 0;
-        std::vector<giftCurlData> curlVars;
-        curlVars.reserve(mgGens.size() * 2);
-
-        Gui::waitFrame(i18n::localize("MYSTERY_GIFT_CHECK"));
+        }
 
-        for (auto& gen : mgGens)
+        size_t filesDone       = 0;
+        size_t filesToDownload = 0;
+        size_t downloadsDone   = 0;
+        std::array<bool, mgGens.size()> genSettled{};
+        while (filesDone != update->files.size())
         {
-            for (const std::string& fileName : {"sheet" + genToString(gen) + ".json.bz2", "data" + genToString(gen) + ".bin.bz2"})
+            for (size_t i = 0; i < update->files.size(); i++)
             {
-                std::array<u8, SHA256_BLOCK_SIZE> checksum = readGiftChecksum(fileName);
-
-                std::vector<u8> recvChecksum;
-                if (auto fetch = Fetch::init("https://flagbrew.org/static/other/gifts/" + fileName + ".sha", true, nullptr, nullptr, ""))
+                GiftFile& file = update->files[i];
+                bool isData    = i % 2 == 1;
+                if (file.state == GiftFile::State::CHECKING && file.hashed && file.remoteStatus != -1)
                 {
-                    fetch->setopt(CURLOPT_WRITEFUNCTION, (curl_write_callback)[](char* buffer, size_t size, size_t items, void* userThing) {
-                        std::vector<u8>* recv = (std::vector<u8>*)userThing;
-                        recv->insert(recv->end(), (u8*)buffer, (u8*)buffer + size * items);
-                        return size * items;
-                    });
-                    fetch->setopt(CURLOPT_WRITEDATA, &recvChecksum);
-
-                    Fetch::perform(fetch);
-
-                    long response;
-
-                    fetch->getinfo(CURLINFO_RESPONSE_CODE, &response);
-                    if (response == 200)
+                    file.state = GiftFile::State::DONE;
+                    if (file.remoteStatus == 200 && file.remoteChecksum.size() >= SHA256_BLOCK_SIZE &&
+                        memcmp(file.remoteChecksum.data(), file.localChecksum.data(), SHA256_BLOCK_SIZE))
                     {
-                        if (memcmp(recvChecksum.data(), checksum.data(), std::min(checksum.size(), recvChecksum.size())))
+                        if (isData && worker)
                         {
-                            if (fetch = Fetch::init("https://flagbrew.org/static/other/gifts/" + fileName, true, nullptr, nullptr, ""))
+                            if (auto fetch = Fetch::init(
+                                    update->url + "manifest" + genToString(mgGens[i / 2]) + ".bin", true, &file.manifest, nullptr, ""))
                             {
-                                std::string outPath = "/3ds/PKSM/mysterygift/" + fileName;
-                                FILE* outFile       = fopen(outPath.c_str(), "wb");
-
-                                if (outFile)
+                                if (Fetch::performAsync(fetch, [&file](CURLcode code, std::shared_ptr<Fetch> fetch) {
+                                        long response = 0;
+                                        fetch->getinfo(CURLINFO_RESPONSE_CODE, &response);
+                                        file.manifestStatus = code == CURLE_OK ? response : 0;
+                                    }) == CURLM_OK)
                                 {
-                                    curlVars.emplace_back(outFile, outPath);
-                                    fetch->setopt(CURLOPT_WRITEFUNCTION, giftWriteFunc);
-                                    fetch->setopt(CURLOPT_WRITEDATA, &curlVars.back());
-
-                                    if (Fetch::performAsync(
-                                            fetch, [progress = curlVars.end() - 1, &filesDone](CURLcode code, std::shared_ptr<Fetch> fetch) {
-                                                filesDone++;
-                                                fclose(progress->file);
-                                                fetch->getinfo(CURLINFO_RESPONSE_CODE, &progress->response);
-                                            }) != CURLM_OK)
-                                    {
-                                        filesDone++;
-                                        fclose(outFile);
-                                    }
-                                    else
-                                    {
-                                        filesToDownload++;
-                                    }
+                                    file.state = GiftFile::State::DELTA;
                                 }
                             }
                         }
+                        if (file.state != GiftFile::State::DELTA)
+                        {
+                            startDownload(file);
+                        }
+                        if (file.state != GiftFile::State::DONE)
+                        {
+                            filesToDownload++;
+                        }
+                    }
+                    if (file.state == GiftFile::State::DONE)
+                    {
+                        filesDone++;
                     }
                 }
-            }
-        }
+                else if (file.state == GiftFile::State::DELTA && file.manifestStatus != -1)
+                {
+                    if (!file.deltaQueued && file.manifestStatus == 200)
+                    {
+                        file.deltaQueued     = true;
+                        update->delta[i / 2] = true;
+                    }
+                    else if (file.deltaQueued && file.deltaResult == 1)
+                    {
+                        writeGiftChecksum(file.fileName, (const u8*)file.remoteChecksum.data());
+                        file.changed = true;
+                        file.state   = GiftFile::State::DONE;
+                    }
+                    // The manifest couldn't be had, or didn't help
+                    else if (!file.deltaQueued || file.deltaResult == 0)
+                    {
+                        startDownload(file);
+                    }
 
-        while (filesDone != filesToDownload)
-        {
-            Gui::waitFrame(fmt::format(i18n::localize("MYSTERY_GIFT_DOWNLOAD"), (size_t)filesDone, filesToDownload));
-            svcSleepThread(50'000'000);
-        }
+                    if (file.state == GiftFile::State::DONE)
+                    {
+                        filesDone++;
+                        downloadsDone++;
+                    }
+                }
+                else if (file.state == GiftFile::State::DOWNLOADING && file.downloaded)
+                {
+                    // Anything corrupted on the way is dropped and the old file stays in place. Something cut short is kept as a .part
+                    // file, which the next update resumes
+                    if (file.downloadResult == 0)
+                    {
+                        writeGiftChecksum(file.fileName, (const u8*)file.remoteChecksum.data());
+                        // Drop what an earlier delta rebuilt, which this replaces
+                        if (isData)
+                        {
+                            std::string path = "/3ds/PKSM/mysterygift/" + file.fileName;
+                            remove(path.substr(0, path.size() - 4).c_str());
+                        }
+                        file.changed = true;
+                    }
 
-        for (auto& info : curlVars)
-        {
-            std::string shaFile = info.fileName + ".sha";
-            if (info.response != 200)
-            {
-                remove(info.fileName.c_str());
-                remove(shaFile.c_str());
+                    file.state = GiftFile::State::DONE;
+                    filesDone++;
+                    downloadsDone++;
+                }
             }
-            else
+
+            for (size_t i = 0; i < mgGens.size(); i++)
             {
-                std::array<u8, SHA256_BLOCK_SIZE> checksum;
-                sha256_final(&info.shaContext, checksum.data());
+                const GiftFile& sheet = update->files[i * 2];
+                const GiftFile& data  = update->files[i * 2 + 1];
+                if (!genSettled[i] && sheet.state == GiftFile::State::DONE && data.state == GiftFile::State::DONE)
+                {
+                    genSettled[i] = true;
+                    if (sheet.changed || data.changed)
+                    {
+                        update->convert[i] = true;
+                    }
+                }
+            }
 
-                FILE* f = fopen(shaFile.c_str(), "wb");
-                if (f)
+            if (filesDone != update->files.size())
+            {
+                if (filesToDownload > 0)
                 {
-                    fwrite(checksum.data(), 1, checksum.size(), f);
-                    fclose(f);
+                    Gui::waitFrame(fmt::format(i18n::localize("MYSTERY_GIFT_DOWNLOAD"), downloadsDone, filesToDownload));
                 }
+                svcSleepThread(10'000'000);
             }
         }
+
+        update->downloadsDone = true;
+        while (worker && !update->workerDone)
+        {
+            svcSleepThread(10'000'000);
+        }
     }
 }
 
@@ -808,6 +954,11 @@ Result App::init(const std::string& execPath)
     {
         return consoleDisplayError("Initializing network connection failed.", -1);
     }
+    HttpCache::init();
+    DownloadCounter::init();
+    GPSSStore::init();
+    GPSSUpload::init();
+    MysteryGift::initPreloading();
 
     if (R_FAILED(res = downloadAdditionalAssets()))
         return consoleDisplayError(
@@ -873,7 +1024,15 @@ Result App::exit(void)
     svcCloseHandle(hbldrHandle);
     TitleLoader::exit();
     Gui::exit();
+    DownloadCounter::exit();
+    GPSSStore::exit();
+    GPSSUpload::exit();
+    MysteryGift::exitPreloading();
+#if FETCH_METRICS
+    Fetch::dumpMetrics("/3ds/PKSM/fetchmetrics.txt");
+#endif
     Fetch::exitMulti();
+    HttpCache::exit();
     socExit();
     acExit();
     doCartScan.clear();
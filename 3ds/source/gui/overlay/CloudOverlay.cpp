@@ -28,6 +28,8 @@
 #include "ClickButton.hpp"
 #include "CloudAccess.hpp"
 #include "Configuration.hpp"
+#include "PKFilter.hpp"
+#include "PKX.hpp"
 #include "ToggleButton.hpp"
 #include "gui.hpp"
 #include "loader.hpp"
@@ -45,9 +47,30 @@ namespace
         }
         return "";
     }
+
+    std::string searchToString(const CloudAccess& access)
+    {
+        if (!access.searching())
+        {
+            return "CLOUD_SEARCH_OFF";
+        }
+        switch (access.searchQuery().order)
+        {
+            case CloudAccess::Search::PAGE_ORDER:
+                return "CLOUD_SEARCH_MATCHES";
+            case CloudAccess::Search::SPECIES:
+                return "CLOUD_SEARCH_BY_SPECIES";
+            case CloudAccess::Search::LEVEL:
+                return "CLOUD_SEARCH_BY_LEVEL";
+            case CloudAccess::Search::GENERATION:
+                return "CLOUD_SEARCH_BY_GENERATION";
+        }
+        return "";
+    }
 }
 
-CloudOverlay::CloudOverlay(ReplaceableScreen& screen, CloudAccess& acc) : ReplaceableScreen(&screen), access(acc)
+CloudOverlay::CloudOverlay(ReplaceableScreen& screen, CloudAccess& acc, std::shared_ptr<PKFilter> filter)
+    : ReplaceableScreen(&screen), access(acc), filter(filter)
 {
     buttons.push_back(std::make_unique<ClickButton>(106, 82, 108, 28,
         [this]() {
@@ -75,12 +98,41 @@ CloudOverlay::CloudOverlay(ReplaceableScreen& screen, CloudAccess& acc) : Replac
     tbutton = std::make_unique<ToggleButton>(106, 144, 108, 28,
         [this]() {
             access.filterLegal(!access.filterLegal());
+            if (access.searching())
+            {
+                CloudAccess::Search query = access.searchQuery();
+                query.legalOnly           = access.filterLegal();
+                access.showSearch(query);
+            }
             return access.filterLegal();
         },
         ui_sheet_button_editor_idx, i18n::localize("LEGALITY_LEGAL"), FONT_SIZE_12, COLOR_BLACK, ui_sheet_button_editor_idx,
         i18n::localize("LEGALITY_ANY"), FONT_SIZE_12, COLOR_BLACK, nullptr, true);
     tbutton->setState(access.filterLegal());
     buttons.push_back(std::move(tbutton));
+    // Cycles from the server's pages to the downloaded Pokémon that match the filter, in each order they can be sorted in, and back
+    buttons.push_back(std::make_unique<ClickButton>(106, 175, 108, 28,
+        [this]() {
+            if (!access.searching())
+            {
+                CloudAccess::Search query;
+                query.legalOnly = access.filterLegal();
+                query.match     = [filter = this->filter](const PKX& pkm) { return pkm == *filter; };
+                access.showSearch(query);
+            }
+            else if (access.searchQuery().order != CloudAccess::Search::GENERATION)
+            {
+                CloudAccess::Search query = access.searchQuery();
+                query.order               = CloudAccess::Search::Order(query.order + 1);
+                access.showSearch(query);
+            }
+            else
+            {
+                access.clearSearch();
+            }
+            return false;
+        },
+        ui_sheet_button_editor_idx, "", FONT_SIZE_12, COLOR_BLACK));
     buttons.push_back(std::make_unique<ClickButton>(283, 211, 34, 28,
         [this]() {
             parent->removeOverlay();
@@ -107,6 +159,8 @@ void CloudOverlay::drawBottom() const
     Gui::text(i18n::localize("CLOUD_SORT_FILTER"), 25, 5, FONT_SIZE_12, COLOR_WHITE, TextPosX::LEFT, TextPosY::TOP);
     Gui::text(i18n::localize(sortTypeToString(access.sortType())), 160, 96, FONT_SIZE_12, COLOR_BLACK, TextPosX::CENTER, TextPosY::CENTER,
         TextWidthAction::WRAP, 108);
+    Gui::text(i18n::localize(searchToString(access)), 160, 189, FONT_SIZE_12, COLOR_BLACK, TextPosX::CENTER, TextPosY::CENTER,
+        TextWidthAction::WRAP, 108);
 }
 
 void CloudOverlay::update(touchPosition* touch)
@@ -32,6 +32,7 @@
 #include "Configuration.hpp"
 #include "FSStream.hpp"
 #include "FilterScreen.hpp"
+#include "GPSSUpload.hpp"
 #include "GroupCloudScreen.hpp"
 #include "PK7.hpp"
 #include "PKFilter.hpp"
@@ -90,6 +91,7 @@ CloudScreen::CloudScreen(int storageBox, std::shared_ptr<PKFilter> filter)
 {
     mainButtons[0] = std::make_unique<ClickButton>(212, 78, 108, 28,
         [this]() {
+            filterEdited = true;
             Gui::setScreen(std::make_unique<FilterScreen>(this->filter));
             return true;
         },
@@ -353,6 +355,13 @@ void CloudScreen::update(touchPosition* touch)
         Gui::screenBack();
         return;
     }
+    if (filterEdited)
+    {
+        // The search matches against the filter, which may have just changed
+        filterEdited = false;
+        access.refreshSearch();
+    }
+    access.update();
     if (justSwitched)
     {
         if ((keysHeld() | keysDown()) & KEY_TOUCH)
@@ -384,6 +393,19 @@ void CloudScreen::update(touchPosition* touch)
             }
             shareSend();
         }
+        else if (!cloudChosen && cursorIndex == 0)
+        {
+            // On the box name, so the whole box goes, in the background
+            if (Gui::showChoiceMessage(i18n::localize("SHARE_BOX_CONFIRM")))
+            {
+                std::vector<std::shared_ptr<PKX>> box;
+                for (int slot = 0; slot < 30; slot++)
+                {
+                    box.emplace_back(Banks::bank->pkm(storageBox, slot));
+                }
+                GPSSUpload::queue(box);
+            }
+        }
         else
         {
             shareReceive();
@@ -420,7 +442,7 @@ void CloudScreen::update(touchPosition* touch)
     }
     else if (kDown & KEY_START)
     {
-        addOverlay<CloudOverlay>(access);
+        addOverlay<CloudOverlay>(access, filter);
         justSwitched = true;
     }
     else if (buttonCooldown <= 0)
@@ -807,7 +829,7 @@ void CloudScreen::shareSend()
     }
 
     std::string writeData = "";
-    if (auto fetch = Fetch::init("https://flagbrew.org/gpss/share", true, &writeData, headers, ""))
+    if (auto fetch = Fetch::init(Configuration::getInstance().gpssServer() + "/gpss/share", true, &writeData, headers, ""))
     {
         auto mimeThing       = fetch->mimeInit();
         curl_mimepart* field = curl_mime_addpart(mimeThing.get());
@@ -881,7 +903,7 @@ void CloudScreen::shareReceive()
     }
     if (ret == SWKBD_BUTTON_CONFIRM)
     {
-        const std::string url  = "https://flagbrew.org/gpss/download/" + std::string(input);
+        const std::string url  = Configuration::getInstance().gpssServer() + "/gpss/download/" + std::string(input);
         std::string retB64Data = "";
         if (auto fetch = Fetch::init(url, true, &retB64Data, nullptr, ""))
         {
@@ -344,6 +344,7 @@ void GroupCloudScreen::update(touchPosition* touch)
         Gui::screenBack();
         return;
     }
+    access.update();
     if (justSwitched)
     {
         if ((keysHeld() | keysDown()) & KEY_TOUCH)
@@ -828,7 +829,7 @@ void GroupCloudScreen::shareReceive()
     }
     if (ret == SWKBD_BUTTON_CONFIRM)
     {
-        const std::string url = "https://flagbrew.org/gpss/download/bundle/" + std::string(input);
+        const std::string url = Configuration::getInstance().gpssServer() + "/gpss/download/bundle/" + std::string(input);
         std::string jsonData  = "";
         if (auto fetch = Fetch::init(url, true, &jsonData, nullptr, ""))
         {
@@ -42,7 +42,6 @@
 #include "i18n.hpp"
 #include "loader.hpp"
 #include "mysterygift.hpp"
-#include "nlohmann/json.hpp"
 #include <sys/stat.h>
 
 namespace
@@ -51,13 +50,13 @@ namespace
 }
 
 InjectSelectorScreen::InjectSelectorScreen()
-    : Screen(
-          i18n::localize("A_SELECT") + '\n' + i18n::localize("L_PAGE_PREV") + '\n' + i18n::localize("R_PAGE_NEXT") + '\n' + i18n::localize("B_BACK")),
+    : Screen(i18n::localize("A_SELECT") + '\n' + i18n::localize("L_PAGE_PREV") + '\n' + i18n::localize("R_PAGE_NEXT") + '\n' +
+             i18n::localize("Y_SEARCH") + '\n' + i18n::localize("B_BACK")),
       hid(10, 2),
       dumpHid(40, 8)
 {
     MysteryGift::init(TitleLoader::save->generation());
-    wondercards = MysteryGift::wondercards();
+    filter();
 
     gifts = TitleLoader::save->currentGifts();
 
@@ -107,12 +106,24 @@ void InjectSelectorScreen::update(touchPosition* touch)
             doQR();
             return;
         }
-        if (downKeys & KEY_A)
+        if (downKeys & KEY_A && !wondercards.empty())
         {
+            // Cards that fail their checksum come back empty. Updating the gifts replaces them
+            if (!MysteryGift::wondercard(
+                    MysteryGift::eventCard(wondercards[hid.fullIndex()], i18n::langString(Configuration::getInstance().language()))))
+            {
+                Gui::warn(i18n::localize("MYSTERY_GIFT_CORRUPT"));
+                return;
+            }
             Gui::setScreen(std::make_unique<InjectorScreen>(wondercards[hid.fullIndex()]));
             updateGifts = true;
             return;
         }
+        if (downKeys & KEY_Y)
+        {
+            searchBar();
+            return;
+        }
         if (downKeys & KEY_X)
         {
             if (TitleLoader::save->generation() == Generation::LGPE)
@@ -262,16 +273,8 @@ void InjectSelectorScreen::drawTop() const
             }
             else
             {
-                Sav::giftData data;
-                const std::string& lang = i18n::langString(Configuration::getInstance().language());
-                if (wondercards[i].find(lang) != wondercards[i].end())
-                {
-                    data = MysteryGift::wondercardInfo(wondercards[i][lang]);
-                }
-                else
-                {
-                    data = MysteryGift::wondercardInfo(*wondercards[i].begin());
-                }
+                const std::string& lang           = i18n::langString(Configuration::getInstance().language());
+                const MysteryGift::CardInfo& data = MysteryGift::wondercardInfo(MysteryGift::eventCard(wondercards[i], lang));
                 int x = i % 2 == 0 ? 21 : 201;
                 int y = 43 + ((i % 10) / 2) * 37;
                 if (data.species == -1)
@@ -284,7 +287,7 @@ void InjectSelectorScreen::drawTop() const
                 }
                 PKSM_Color color       = i == hid.fullIndex() ? PKSM_Color(232, 234, 246, 255) : PKSM_Color(26, 35, 126, 255);
                 TextWidthAction action = i == hid.fullIndex() ? TextWidthAction::SQUISH_OR_SCROLL : TextWidthAction::SQUISH_OR_SLICE;
-                Gui::text(data.name, x + 103, y + 14, FONT_SIZE_11, color, TextPosX::CENTER, TextPosY::CENTER, action, 138.0f);
+                Gui::text(*data.name, x + 103, y + 14, FONT_SIZE_11, color, TextPosX::CENTER, TextPosY::CENTER, action, 138.0f);
             }
         }
     }
@@ -381,24 +384,35 @@ void InjectSelectorScreen::dumpCard(void) const
 
 bool InjectSelectorScreen::toggleFilter(const std::string& lang)
 {
-    if (langFilter != lang)
-    {
-        wondercards = MysteryGift::wondercards();
-        for (size_t i = wondercards.size(); i > 0; i--)
-        {
-            if (!wondercards[i - 1].contains(lang))
-            {
-                wondercards.erase(wondercards.begin() + i - 1);
-            }
-        }
-        langFilter = lang;
-    }
-    else
+    langFilter = langFilter != lang ? lang : "";
+    filter();
+    return false;
+}
+
+void InjectSelectorScreen::searchBar()
+{
+    SwkbdState state;
+    swkbdInit(&state, SWKBD_TYPE_NORMAL, 2, 20);
+    swkbdSetHintText(&state, i18n::localize("SEARCH").c_str());
+    swkbdSetValidation(&state, SWKBD_ANYTHING, 0, 0);
+    swkbdSetInitialText(&state, searchString.c_str());
+    char input[25]  = {0};
+    SwkbdButton ret = swkbdInputText(&state, input, sizeof(input));
+    input[24]       = '\0';
+    if (ret == SWKBD_BUTTON_CONFIRM)
     {
-        wondercards = MysteryGift::wondercards();
-        langFilter  = "";
+        searchString = input;
+        hid.select(0);
+        filter();
     }
-    return false;
+}
+
+void InjectSelectorScreen::filter()
+{
+    MysteryGift::Search search;
+    search.text = searchString;
+    search.lang = langFilter;
+    wondercards = MysteryGift::search(search);
 }
 
 bool InjectSelectorScreen::toggleFilter(u8 type)
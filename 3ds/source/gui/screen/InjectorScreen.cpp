@@ -34,7 +34,6 @@
 #include "i18n.hpp"
 #include "loader.hpp"
 #include "mysterygift.hpp"
-#include "nlohmann/json.hpp"
 
 namespace
 {
@@ -45,33 +44,27 @@ bool InjectorScreen::setLanguage(Language language)
 {
     if (isLangAvailable(language))
     {
+        auto card = MysteryGift::wondercard(MysteryGift::eventCard(*event, i18n::langString(language)));
+        if (!card)
+        {
+            Gui::warn(i18n::localize("MYSTERY_GIFT_CORRUPT"));
+            return false;
+        }
         lang       = language;
-        wondercard = MysteryGift::wondercard((*ids)[i18n::langString(lang)]);
+        wondercard = std::move(card);
 
         wondercard->date(Configuration::getInstance().date());
     }
     return false;
 }
 
-InjectorScreen::InjectorScreen(nlohmann::json myIds)
-    : hid(40, 8),
-      ids(std::make_unique<nlohmann::json>(myIds)),
-      gifts(TitleLoader::save->currentGifts()),
-      emptySlot(TitleLoader::save->emptyGiftLocation())
+InjectorScreen::InjectorScreen(size_t myEvent)
+    : hid(40, 8), event(myEvent), gifts(TitleLoader::save->currentGifts()), emptySlot(TitleLoader::save->emptyGiftLocation())
 {
-    const std::string& langString = i18n::langString(Configuration::getInstance().language());
-    if (ids->find(langString) != ids->end())
-    {
-        wondercard = MysteryGift::wondercard((*ids)[langString]);
-        game       = MysteryGift::wondercardInfo((*ids)[langString]).game;
-        lang       = Configuration::getInstance().language();
-    }
-    else
-    {
-        wondercard = MysteryGift::wondercard(*ids->begin());
-        game       = MysteryGift::wondercardInfo(*ids->begin()).game;
-        lang       = i18n::langFromString(ids->begin().key());
-    }
+    size_t card = MysteryGift::eventCard(*event, i18n::langString(Configuration::getInstance().language()));
+    wondercard  = MysteryGift::wondercard(card);
+    game        = *MysteryGift::wondercardInfo(card).game;
+    lang        = i18n::langFromString(std::string(MysteryGift::wondercardInfo(card).lang));
 
     slot          = emptySlot + 1;
     int langIndex = 1;
@@ -551,5 +544,5 @@ void InjectorScreen::update(touchPosition* touch)
 
 bool InjectorScreen::isLangAvailable(Language l) const
 {
-    return ids && ids->find(i18n::langString(l)) != ids->end();
+    return event && MysteryGift::hasLanguage(*event, i18n::langString(l));
 }
@@ -38,6 +38,7 @@
 #include "format.h"
 #include "gui.hpp"
 #include "loader.hpp"
+#include "mysterygift.hpp"
 #include "revision.h"
 
 namespace
@@ -92,6 +93,7 @@ MainMenu::MainMenu()
         ((Sav5*)TitleLoader::save.get())->cryptMysteryGiftData();
     }
     sha256(oldHash.data(), TitleLoader::save->rawData().get(), TitleLoader::save->getLength());
+    MysteryGift::preload(TitleLoader::save->generation());
     makeButtons();
     makeInstructions();
 }
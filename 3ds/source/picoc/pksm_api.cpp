@@ -53,6 +53,7 @@
 #include "gui.hpp"
 #include "i18n.hpp"
 #include "loader.hpp"
+#include "mysterygift.hpp"
 #include "random.hpp"
 #include "utils.hpp"
 #include <algorithm>
@@ -1936,6 +1937,64 @@ void sav_wcx_free_slot(struct ParseState* Parser, struct Value* ReturnValue, str
     ReturnValue->Val->Integer = TitleLoader::save->emptyGiftLocation();
 }
 
+void sav_inject_gifts(struct ParseState* Parser, struct Value* ReturnValue, struct Value** Param, int NumArgs)
+{
+    int* events = (int*)Param[0]->Val->Pointer;
+    int count   = Param[1]->Val->Integer;
+
+    // Every card is decoded and written in one go, rather than going through the script for each of them
+    MysteryGift::init(TitleLoader::save->generation());
+    const std::string lang = i18n::langString(TitleLoader::save->language());
+    std::vector<size_t> cards;
+    for (int i = 0; i < count; i++)
+    {
+        if (events[i] >= 0 && size_t(events[i]) < MysteryGift::wondercards())
+        {
+            cards.push_back(MysteryGift::eventCard(events[i], lang));
+        }
+    }
+    ReturnValue->Val->Integer = MysteryGift::inject(*TitleLoader::save, cards);
+    MysteryGift::exit();
+}
+
+void gift_count(struct ParseState* Parser, struct Value* ReturnValue, struct Value** Param, int NumArgs)
+{
+    MysteryGift::init(TitleLoader::save->generation());
+    ReturnValue->Val->Integer = MysteryGift::wondercards();
+    MysteryGift::exit();
+}
+
+void gift_name(struct ParseState* Parser, struct Value* ReturnValue, struct Value** Param, int NumArgs)
+{
+    int event = Param[0]->Val->Integer;
+
+    // The name of the card sav_inject_gifts would pick, so that scripts can show what they're about to inject
+    MysteryGift::init(TitleLoader::save->generation());
+    std::string name;
+    if (event >= 0 && size_t(event) < MysteryGift::wondercards())
+    {
+        name = *MysteryGift::wondercardInfo(MysteryGift::eventCard(event, i18n::langString(TitleLoader::save->language()))).name;
+    }
+    MysteryGift::exit();
+    ReturnValue->Val->Pointer = strToRet(name);
+}
+
+void gift_id(struct ParseState* Parser, struct Value* ReturnValue, struct Value** Param, int NumArgs)
+{
+    int event = Param[0]->Val->Integer;
+
+    MysteryGift::init(TitleLoader::save->generation());
+    ReturnValue->Val->Integer = -1;
+    if (event >= 0 && size_t(event) < MysteryGift::wondercards())
+    {
+        if (auto wc = MysteryGift::wondercard(MysteryGift::eventCard(event, i18n::langString(TitleLoader::save->language()))))
+        {
+            ReturnValue->Val->Integer = wc->ID();
+        }
+    }
+    MysteryGift::exit();
+}
+
 void pksm_base64_decode(struct ParseState* Parser, struct Value* ReturnValue, struct Value** Param, int NumArgs)
 {
     u8** out     = (u8**)Param[0]->Val->Pointer;
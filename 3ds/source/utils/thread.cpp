@@ -58,14 +58,16 @@ void Threads::init()
     LightLock_Init(&listLock);
 }
 
-bool Threads::create(void (*entrypoint)(void*), void* arg, std::optional<size_t> stackSize)
+bool Threads::create(void (*entrypoint)(void*), void* arg, std::optional<size_t> stackSize, bool background)
 {
     s32 prio = 0;
     svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+    // Lower numbers are higher priorities
+    prio = background ? prio + 1 : prio - 1;
     LightLock_Lock(&listLock);
     threads.emplace_front(entrypoint, arg, nullptr);
     threads.front().listPos = threads.begin();
-    threads.front().thread  = threadCreate(threadWrap, (void*)&threads.front(), stackSize.value_or(4 * 1024), prio - 1, -2, true);
+    threads.front().thread  = threadCreate(threadWrap, (void*)&threads.front(), stackSize.value_or(4 * 1024), prio, -2, true);
     if (!threads.front().thread)
     {
         threads.erase(threads.begin());
@@ -0,0 +1,619 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+// Packs the EventsGallery into everything PKSM downloads for mystery gifts: the sheetN.json.bz2/dataN.bin.bz2 pair and their checksums,
+// the manifest and cards for delta updates, and the gift database PKSM converts the pair into. Cards are parsed on every core at once.
+// Build it from this directory with
+//     g++ -std=c++17 -O2 -pthread -I../include -I../../core/include -I../../core/include/utils packer.cpp ../source/GiftDB.cpp
+//         ../../core/source/utils/sha256.c -lbz2 -o packer
+// and run it as packer [gallery directory] [output directory], which default to ./EventsGallery and ./out
+
+#include "GiftDB.hpp"
+#include "gen4string.hpp"
+#include "nlohmann/json.hpp"
+#include "sha256.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bzlib.h>
+#include <filesystem>
+#include <future>
+#include <optional>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const std::array<std::string, 9> VALID_LANGS = {"CHS", "CHT", "ENG", "FRE", "GER", "ITA", "JPN", "KOR", "SPA"};
+    const std::array<std::string, 8> VALID_TYPES = {"wc7", "wc6", "wc7full", "wc6full", "pgf", "wc4", "pgt", "pcd"};
+
+    struct Card
+    {
+        std::string type;
+        std::string game;
+        std::string lang;
+        std::string name;
+        int id;
+        int species;
+        int form;
+        int gender;
+        std::vector<u8> data;
+    };
+
+    // Everything past the end of a card is an error, like it would be in the old packer
+    u8 read8(const std::vector<u8>& data, size_t offset)
+    {
+        return data.at(offset);
+    }
+
+    u16 read16(const std::vector<u8>& data, size_t offset)
+    {
+        return data.at(offset) | data.at(offset + 1) << 8;
+    }
+
+    void appendUTF8(std::string& out, char32_t c)
+    {
+        if (c < 0x80)
+        {
+            out += char(c);
+        }
+        else if (c < 0x800)
+        {
+            out += char(0xC0 | c >> 6);
+            out += char(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000)
+        {
+            out += char(0xE0 | c >> 12);
+            out += char(0x80 | (c >> 6 & 0x3F));
+            out += char(0x80 | (c & 0x3F));
+        }
+        else
+        {
+            out += char(0xF0 | c >> 18);
+            out += char(0x80 | (c >> 12 & 0x3F));
+            out += char(0x80 | (c >> 6 & 0x3F));
+            out += char(0x80 | (c & 0x3F));
+        }
+    }
+
+    // Stops at the first terminator, which is a whole character of 0x0000 or 0xFFFF depending on the game
+    std::optional<std::string> utf16(const std::vector<u8>& data, size_t offset, size_t size, u16 terminator)
+    {
+        std::string ret;
+        for (size_t i = 0; i < size; i += 2)
+        {
+            char32_t c = read16(data, offset + i);
+            if (c == terminator)
+            {
+                break;
+            }
+            if (c >= 0xD800 && c < 0xDC00 && i + 2 < size && read16(data, offset + i + 2) >= 0xDC00 && read16(data, offset + i + 2) < 0xE000)
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + (read16(data, offset + i + 2) - 0xDC00);
+                i += 2;
+            }
+            else if (c >= 0xD800 && c < 0xE000)
+            {
+                return std::nullopt;
+            }
+            appendUTF8(ret, c);
+        }
+        return ret;
+    }
+
+    std::optional<std::string> gen4String(const std::vector<u8>& data, size_t offset, size_t size)
+    {
+        std::string ret;
+        std::optional<u16> c;
+        for (size_t i = 0; i < size; i += 2)
+        {
+            u16 value = read16(data, offset + i);
+            if (value == 0xFFFF)
+            {
+                break;
+            }
+            auto found = std::lower_bound(Gen4String::G4_VALUES.begin(), Gen4String::G4_VALUES.end(), value);
+            if (found == Gen4String::G4_VALUES.end() || *found != value)
+            {
+                break;
+            }
+            size_t index = found - Gen4String::G4_VALUES.begin();
+            // The first character doesn't have a translation, so it repeats whatever came before it
+            if (index > 0)
+            {
+                c = Gen4String::G4_CHARS[index];
+            }
+            if (!c)
+            {
+                return std::nullopt;
+            }
+            if (*c == 0xFFFF)
+            {
+                break;
+            }
+            appendUTF8(ret, *c);
+        }
+        return ret;
+    }
+
+    std::string replaceAll(std::string str, const std::string& from, const std::string& to)
+    {
+        for (size_t pos = str.find(from); pos != std::string::npos; pos = str.find(from, pos + to.size()))
+        {
+            str.replace(pos, from.size(), to);
+        }
+        return str;
+    }
+
+    std::string numbered(const char* format, int id, const std::string& name)
+    {
+        char prefix[16];
+        snprintf(prefix, sizeof(prefix), format, id);
+        return prefix + name;
+    }
+
+    // Species, form, and gender of the Pokemon in a Gen IV card's PK4, if it has one
+    void gen4Pokemon(Card& card, u16 manaphy)
+    {
+        if (read8(card.data, 0) == 1 || read8(card.data, 0) == 2)
+        {
+            card.species = read16(card.data, 0x8 + 0x8);
+            card.form    = read8(card.data, 0x8 + 0x40) >> 3;
+            card.gender  = read8(card.data, 0x8 + 0x40) >> 1 & 0x3;
+        }
+        else if (read8(card.data, 0) == 7)
+        {
+            card.species = manaphy;
+            // Special meaning for Manaphy: egg
+            card.form   = -1;
+            card.gender = 2;
+        }
+        else
+        {
+            card.species = -1;
+            card.form    = -1;
+            card.gender  = -1;
+        }
+    }
+
+    // Gen VI and VII cards, which only differ in where the card starts in the full versions
+    bool parse3DSCard(Card& card, const std::string& fileName, size_t start, bool nameFallback)
+    {
+        bool item    = read8(card.data, start + 0x51) != 0;
+        card.species = item ? -1 : read16(card.data, start + 0x82);
+        card.form    = item ? -1 : read8(card.data, start + 0x84);
+        card.gender  = item ? -1 : read8(card.data, start + 0xA1);
+        card.id      = read16(card.data, start);
+
+        auto title = utf16(card.data, start + 0x2, 0x4A, 0x0000);
+        if (!title)
+        {
+            return false;
+        }
+        if (title->empty() && nameFallback)
+        {
+            size_t end = fileName.find('(');
+            title      = replaceAll(fileName.substr(0, end != std::string::npos ? end : fileName.rfind('.')), "Pokemon Link ", "");
+        }
+        card.name = numbered("%04i - ", card.id, *title);
+        return true;
+    }
+
+    std::optional<Card> parse(const fs::path& path)
+    {
+        const std::string fileName = path.filename().string();
+        size_t dot                 = fileName.rfind('.');
+        if (dot == std::string::npos)
+        {
+            return std::nullopt;
+        }
+        std::string name = fileName.substr(0, dot);
+
+        Card card;
+        card.type = fileName.substr(dot + 1);
+        if (std::find(VALID_TYPES.begin(), VALID_TYPES.end(), card.type) == VALID_TYPES.end())
+        {
+            return std::nullopt;
+        }
+
+        // The game is the second word of the name
+        size_t gameStart = name.find(' ');
+        size_t gameEnd   = gameStart == std::string::npos ? std::string::npos : name.find(' ', gameStart + 1);
+        if (gameEnd == std::string::npos)
+        {
+            return std::nullopt;
+        }
+        card.game = name.substr(gameStart + 1, gameEnd - gameStart - 1);
+
+        card.lang = "ENG";
+        for (auto& lang : VALID_LANGS)
+        {
+            if (name.find("(" + lang + ")") != std::string::npos)
+            {
+                card.lang = lang;
+                break;
+            }
+        }
+
+        FILE* f = fopen(path.string().c_str(), "rb");
+        if (!f)
+        {
+            return std::nullopt;
+        }
+        fseek(f, 0, SEEK_END);
+        card.data.resize(ftell(f));
+        rewind(f);
+        bool read = fread(card.data.data(), 1, card.data.size(), f) == card.data.size();
+        fclose(f);
+        if (!read)
+        {
+            return std::nullopt;
+        }
+
+        try
+        {
+            const std::string itemName = replaceAll(replaceAll(replaceAll(name, "Item ", ""), " " + card.game, ""), " (" + card.lang + ")", "");
+            if (card.type == "wc7" || card.type == "wc6")
+            {
+                if (!parse3DSCard(card, fileName, 0, true))
+                {
+                    return std::nullopt;
+                }
+            }
+            else if (card.type == "wc7full" || card.type == "wc6full")
+            {
+                if (!parse3DSCard(card, fileName, 0x208, false))
+                {
+                    return std::nullopt;
+                }
+            }
+            else if (card.type == "pgf")
+            {
+                bool pokemon = read8(card.data, 0xB3) == 1;
+                card.species = pokemon ? read16(card.data, 0x1A) : -1;
+                card.form    = pokemon ? read8(card.data, 0x1C) : -1;
+                card.gender  = pokemon ? read8(card.data, 0x35) : -1;
+                card.id      = read16(card.data, 0xB0);
+
+                auto title = utf16(card.data, 0x60, 0x4A, 0xFFFF);
+                if (!title)
+                {
+                    return std::nullopt;
+                }
+                card.name = numbered("%04i - ", card.id, *title);
+            }
+            else if (card.type == "wc4" || card.type == "pcd")
+            {
+                gen4Pokemon(card, 470);
+                card.id = read16(card.data, 0x150);
+
+                auto title = gen4String(card.data, 0x104, 0x48);
+                if (!title)
+                {
+                    return std::nullopt;
+                }
+                card.name = numbered("%03i - ", card.id, replaceAll(*title, "Mystery Gift ", ""));
+                if (card.name == numbered("%03i - ", card.id, ""))
+                {
+                    card.name = itemName;
+                }
+            }
+            else // pgt
+            {
+                if (path.parent_path().filename() == "Pokemon Ranger Manaphy Egg")
+                {
+                    card.game = "DPPtHGSS";
+                    card.name = "Pokemon Ranger Manaphy Egg";
+                }
+                else
+                {
+                    card.name = itemName;
+                }
+                gen4Pokemon(card, 490);
+
+                // These only have a number if their name starts with one
+                std::string number = card.name.substr(0, 3);
+                if (std::any_of(number.begin(), number.end(), [](char c) { return c >= '0' && c <= '9'; }))
+                {
+                    card.id = atoi(number.c_str());
+                }
+                else
+                {
+                    card.id = 999;
+                }
+            }
+        }
+        catch (const std::out_of_range&)
+        {
+            return std::nullopt;
+        }
+
+        return card;
+    }
+
+    // Files are taken in path order, so the output doesn't depend on the order the file system lists them in
+    std::vector<Card> scan(const std::vector<fs::path>& roots)
+    {
+        std::vector<fs::path> paths;
+        for (auto& root : roots)
+        {
+            std::vector<fs::path> rootPaths;
+            std::error_code error;
+            for (auto it = fs::recursive_directory_iterator(root, error); !error && it != fs::recursive_directory_iterator(); it.increment(error))
+            {
+                if (it->is_regular_file())
+                {
+                    rootPaths.push_back(it->path());
+                }
+            }
+            std::sort(rootPaths.begin(), rootPaths.end());
+            paths.insert(paths.end(), rootPaths.begin(), rootPaths.end());
+        }
+
+        std::vector<std::optional<Card>> parsed(paths.size());
+        std::atomic<size_t> next = 0;
+        std::vector<std::thread> threads(std::max(1u, std::thread::hardware_concurrency()));
+        for (auto& thread : threads)
+        {
+            thread = std::thread([&] {
+                for (size_t i = next++; i < paths.size(); i = next++)
+                {
+                    parsed[i] = parse(paths[i]);
+                }
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        std::vector<Card> ret;
+        ret.reserve(parsed.size());
+        for (auto& card : parsed)
+        {
+            if (card)
+            {
+                ret.emplace_back(std::move(*card));
+            }
+        }
+        return ret;
+    }
+
+    struct MatchKey
+    {
+        int id;
+        int species;
+        int form;
+        int gender;
+
+        bool operator==(const MatchKey& other) const
+        {
+            return id == other.id && species == other.species && form == other.form && gender == other.gender;
+        }
+    };
+
+    struct MatchKeyHash
+    {
+        size_t operator()(const MatchKey& key) const
+        {
+            size_t ret = std::hash<int>{}(key.id);
+            for (int value : {key.species, key.form, key.gender})
+            {
+                ret = ret * 31 + std::hash<int>{}(value);
+            }
+            return ret;
+        }
+    };
+
+    std::vector<u8> compress(const std::vector<u8>& data)
+    {
+        // bzip2 won't take a null pointer even for no data, which a generation without any cards has
+        char empty        = 0;
+        unsigned int size = data.size() + data.size() / 100 + 600;
+        std::vector<u8> ret(size);
+        if (BZ2_bzBuffToBuffCompress((char*)ret.data(), &size, data.empty() ? &empty : (char*)data.data(), data.size(), 9, 0, 30) != BZ_OK)
+        {
+            return {};
+        }
+        ret.resize(size);
+        return ret;
+    }
+
+    std::array<u8, SHA256_BLOCK_SIZE> hash(const std::vector<u8>& data)
+    {
+        std::array<u8, SHA256_BLOCK_SIZE> ret;
+        sha256(ret.data(), data.data(), data.size());
+        return ret;
+    }
+
+    std::string hex(const u8* data, size_t size)
+    {
+        static constexpr char digits[] = "0123456789abcdef";
+        std::string ret;
+        for (size_t i = 0; i < size; i++)
+        {
+            ret += digits[data[i] >> 4];
+            ret += digits[data[i] & 0xF];
+        }
+        return ret;
+    }
+
+    bool write(const fs::path& path, const void* data, size_t size)
+    {
+        FILE* f = fopen(path.string().c_str(), "wb");
+        if (!f)
+        {
+            return false;
+        }
+        bool ret = fwrite(data, 1, size, f) == size;
+        return fclose(f) == 0 && ret;
+    }
+
+    template <typename Container>
+    bool write(const fs::path& path, const Container& data)
+    {
+        return write(path, data.data(), data.size() * sizeof(data[0]));
+    }
+
+    bool pack(int gen, const std::vector<Card>& cards, const fs::path& out)
+    {
+        nlohmann::json sheet = {{"gen", std::to_string(gen)}, {"wondercards", nlohmann::json::array()}, {"matches", nlohmann::json::array()}};
+        std::vector<u8> data;
+        std::vector<std::pair<int, nlohmann::json>> matches;
+        std::unordered_map<MatchKey, size_t, MatchKeyHash> matchIndices;
+
+        for (size_t i = 0; i < cards.size(); i++)
+        {
+            const Card& card = cards[i];
+            sheet["wondercards"].push_back({{"type", card.type}, {"size", card.data.size()}, {"game", card.game}, {"offset", data.size()},
+                {"species", card.species}, {"form", card.form}, {"gender", card.gender}, {"name", card.name}});
+            data.insert(data.end(), card.data.begin(), card.data.end());
+
+            auto found = matchIndices.try_emplace({card.id, card.species, card.form, card.gender}, matches.size());
+            if (found.second)
+            {
+                matches.emplace_back(card.id, nlohmann::json::object());
+            }
+            matches[found.first->second].second[card.lang] = i;
+        }
+
+        std::stable_sort(matches.begin(), matches.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        for (auto& match : matches)
+        {
+            sheet["matches"].push_back(std::move(match.second));
+        }
+
+        const std::string sheetString = sheet.dump();
+        auto sheetFuture              = std::async(
+            std::launch::async, [&sheetString] { return compress(std::vector<u8>(sheetString.begin(), sheetString.end())); });
+        std::vector<u8> compressedData  = compress(data);
+        std::vector<u8> compressedSheet = sheetFuture.get();
+        if (compressedData.empty() || compressedSheet.empty())
+        {
+            return false;
+        }
+
+        const std::string g                        = std::to_string(gen);
+        const fs::path sheetPath                   = out / ("sheet" + g + ".json.bz2");
+        const fs::path dataPath                    = out / ("data" + g + ".bin.bz2");
+        std::array<u8, SHA256_BLOCK_SIZE> dataHash = hash(compressedData);
+        if (!write(sheetPath, compressedSheet) || !write(out / ("sheet" + g + ".json.bz2.sha"), hash(compressedSheet)) ||
+            !write(dataPath, compressedData) || !write(out / ("data" + g + ".bin.bz2.sha"), dataHash))
+        {
+            return false;
+        }
+
+        // Cards are laid out one after the other, so they cover the data exactly as the manifest needs
+        GiftDB::ManifestHeader header{GiftDB::MANIFEST_MAGIC, GiftDB::MANIFEST_VERSION, {}, {}, u32(cards.size())};
+        std::copy(dataHash.begin(), dataHash.end(), header.archiveHash);
+        std::array<u8, SHA256_BLOCK_SIZE> rawHash = hash(data);
+        std::copy(rawHash.begin(), rawHash.end(), header.dataHash);
+        std::vector<GiftDB::ManifestCard> manifestCards(cards.size());
+        for (size_t i = 0; i < cards.size(); i++)
+        {
+            sha256(manifestCards[i].hash, cards[i].data.data(), cards[i].data.size());
+            manifestCards[i].size = cards[i].data.size();
+            if (!write(out / "cards" / hex(manifestCards[i].hash, sizeof(manifestCards[i].hash)), cards[i].data))
+            {
+                return false;
+            }
+        }
+        std::vector<u8> manifest((u8*)&header, (u8*)&header + sizeof(header));
+        manifest.insert(manifest.end(), (u8*)manifestCards.data(), (u8*)(manifestCards.data() + manifestCards.size()));
+        if (!write(out / ("manifest" + g + ".bin"), manifest))
+        {
+            return false;
+        }
+
+        return GiftDB::convert(sheetPath.string(), dataPath.string(), (out / ("gifts" + g + ".db")).string());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const fs::path gallery = argc > 1 ? argv[1] : "./EventsGallery";
+    const fs::path out     = argc > 2 ? argv[2] : "./out";
+
+    if (fs::exists(gallery))
+    {
+        printf("Pulling from EventsGallery...\n");
+        if (system(("git -C \"" + gallery.string() + "\" pull").c_str()) != 0)
+        {
+            printf("Error while pulling! Continuing with existing repo\n");
+        }
+    }
+    else
+    {
+        printf("Cloning EventsGallery...\n");
+        if (system(("git clone https://github.com/projectpokemon/EventsGallery.git \"" + gallery.string() + "\"").c_str()) != 0)
+        {
+            printf("Could not clone EventsGallery. Aborting...\n");
+            return 1;
+        }
+    }
+
+    std::error_code error;
+    fs::create_directories(out / "cards", error);
+    if (error)
+    {
+        printf("Could not create %s\n", (out / "cards").string().c_str());
+        return 1;
+    }
+
+    printf("Creating data...\n");
+    std::vector<std::future<bool>> packed;
+    for (int gen = 4; gen <= 7; gen++)
+    {
+        std::vector<fs::path> roots = {gallery / "Released" / ("Gen " + std::to_string(gen)) / "Wondercards"};
+        if (gen == 7)
+        {
+            roots.push_back(gallery / "Unreleased" / "Gen 7" / "Movie 21");
+        }
+        else if (gen == 4)
+        {
+            roots.push_back(gallery / "Released" / "Gen 4" / "Pokemon Ranger Manaphy Egg");
+        }
+        // Scanning already uses every core, but compressing and writing one generation can overlap with scanning the next
+        packed.push_back(std::async(std::launch::async, [gen, &out, cards = scan(roots)] { return pack(gen, cards, out); }));
+    }
+
+    int ret = 0;
+    for (int gen = 4; gen <= 7; gen++)
+    {
+        if (!packed[gen - 4].get())
+        {
+            printf("Could not pack gen %i\n", gen);
+            ret = 1;
+        }
+    }
+    return ret;
+}
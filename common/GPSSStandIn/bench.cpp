@@ -0,0 +1,396 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+// Cloud benchmark, run against the stand-in server (or any GPSS server that doesn't mind the uploads). It drives the real CloudAccess,
+// GroupCloudAccess, GPSSUpload and Fetch the way the cloud screens do, one update() per frame, and reports:
+//  - page-flip latency: how long after nextPage/prevPage the page is there, when the user lingers on each page and when they flip as
+//    fast as pages arrive
+//  - memory per cached page: heap used by a decoded GPSSPage, next to the size of its JSON and of its stored form
+//  - upload throughput: a batch of Pokémon through GPSSUpload, for each background concurrency cap given
+//  - Fetch's own timing histograms for each of those, and optionally its raw metrics
+// Build it with make in this directory; make run starts the stand-in and runs this against it. Run it as
+//     gpss-bench [--server http://127.0.0.1:8080] [--flips 20] [--linger ms] [--cached-pages 12] [--prefetch 2] [--uploads 30]
+//         [--concurrency 1,2,4] [--metrics file]
+// It exits with 1 if the server couldn't be used, so that it can gate a CI run
+
+#include "CloudAccess.hpp"
+#include "Configuration.hpp"
+#include "GPSSPage.hpp"
+#include "GPSSUpload.hpp"
+#include "GroupCloudAccess.hpp"
+#include "PKX.hpp"
+#include "fetch.hpp"
+#include "httpcache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        std::string server = "http://127.0.0.1:8080";
+        int flips          = 20;
+        int linger         = 300;
+        size_t cachedPages = 12;
+        size_t prefetch    = 2;
+        size_t uploads     = 30;
+        std::vector<size_t> concurrency{1, 2, 4};
+        std::string metrics;
+    };
+
+    Options options;
+    // How long the screens wait between updates
+    constexpr auto FRAME = std::chrono::microseconds(16'667);
+    // A page that takes longer than this to show up counts as failed
+    constexpr auto PAGE_TIMEOUT = std::chrono::seconds(15);
+
+    double ms(Clock::duration duration)
+    {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    void summary(const char* what, std::vector<double> values)
+    {
+        if (values.empty())
+        {
+            printf("%s: nothing measured\n", what);
+            return;
+        }
+        std::sort(values.begin(), values.end());
+        auto at = [&values](double fraction) { return values[std::min(size_t(fraction * values.size()), values.size() - 1)]; };
+        printf("%s (%zu): p50 %.1f ms, p90 %.1f ms, max %.1f ms\n", what, values.size(), at(0.5), at(0.9), values.back());
+    }
+
+    void fetchSummary(const char* phase)
+    {
+        auto records = Fetch::recentMetrics();
+        size_t reused = std::count_if(records.begin(), records.end(), [](const Fetch::Metrics& record) { return record.reused; });
+        printf("  fetch, last %zu requests of %s: %zu reused a connection\n", records.size(), phase, reused);
+        constexpr std::pair<const char*, curl_off_t Fetch::Metrics::*> fields[] = {
+            {"connect", &Fetch::Metrics::connect}, {"first byte", &Fetch::Metrics::firstByte}, {"total", &Fetch::Metrics::total}};
+        for (auto& [name, field] : fields)
+        {
+            Fetch::Histogram histogram = Fetch::histogram(field);
+            printf("  fetch %s: p50 <= %.1f ms, p90 <= %.1f ms, p99 <= %.1f ms\n", name, histogram.percentile(0.5f) / 1000.0,
+                histogram.percentile(0.9f) / 1000.0, histogram.percentile(0.99f) / 1000.0);
+        }
+    }
+
+    // Flips like the screens do: one update() per frame until the new page is in. lingerFor is how long to stay on each page, during
+    // which prefetching carries on
+    template <typename Access>
+    std::vector<double> flip(Access& access, int count, bool forward, std::chrono::milliseconds lingerFor)
+    {
+        std::vector<double> ret;
+        for (int i = 0; i < count; i++)
+        {
+            for (auto until = Clock::now() + lingerFor; Clock::now() < until;)
+            {
+                access.update();
+                std::this_thread::sleep_for(FRAME);
+            }
+
+            auto start = Clock::now();
+            forward ? access.nextPage() : access.prevPage();
+            access.update();
+            while (!access.loaded() && Clock::now() - start < PAGE_TIMEOUT)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                access.update();
+            }
+            if (!access.loaded())
+            {
+                fprintf(stderr, "page %d never arrived\n", access.page());
+                continue;
+            }
+            ret.push_back(ms(Clock::now() - start));
+        }
+        return ret;
+    }
+
+    // Flips the sort order like the overlay does and times the longest single update() until the new page is in, which is how long the
+    // screen would freeze for
+    std::vector<double> sortChanges(CloudAccess& access, int count)
+    {
+        std::vector<double> ret;
+        for (int i = 0; i < count; i++)
+        {
+            access.sortDir(!access.sortAscending());
+            double longest = 0;
+            // Past the debounce, so that the new page has at least been asked for
+            auto settled = Clock::now() + std::chrono::milliseconds(500);
+            auto until   = Clock::now() + PAGE_TIMEOUT;
+            while ((Clock::now() < settled || !access.loaded()) && Clock::now() < until)
+            {
+                std::this_thread::sleep_for(FRAME);
+                auto frame = Clock::now();
+                access.update();
+                longest = std::max(longest, ms(Clock::now() - frame));
+            }
+            ret.push_back(longest);
+        }
+        return ret;
+    }
+
+    size_t heapInUse()
+    {
+#ifdef __GLIBC__
+        return mallinfo2().uordblks;
+#else
+        return 0;
+#endif
+    }
+
+    // What a decoded page holds on to, for when the allocator can't be asked
+    size_t footprint(const GPSSPage& page)
+    {
+        size_t ret = sizeof(GPSSPage) + page.pkmData.capacity() + page.offsets.capacity() * sizeof(u32) +
+                     page.generations.capacity() * sizeof(Generation) + page.legal.capacity() / 8 + page.groupOffsets.capacity() * sizeof(u32);
+        for (auto* codes : {&page.codes, &page.groupCodes})
+        {
+            ret += codes->capacity() * sizeof(std::string);
+            for (auto& code : *codes)
+            {
+                ret += code.capacity() > 15 ? code.capacity() + 1 : 0;
+            }
+        }
+        return ret;
+    }
+
+    bool pageMemory()
+    {
+        struct Kind
+        {
+            const char* name;
+            std::string url;
+            std::unique_ptr<GPSSPage> (*parse)(const std::string&);
+        };
+        const Kind kinds[] = {
+            {"page", CloudAccess::makeURL(1, CloudAccess::LATEST, true, false, Generation::THREE, Generation::EIGHT, true), GPSSPage::parse},
+            {"bundle page", GroupCloudAccess::makeURL(1, false, Generation::THREE, Generation::EIGHT, true), GPSSPage::parseGroups}};
+        for (auto& kind : kinds)
+        {
+            std::string body;
+            if (HttpCache::get(kind.url, body) != 200)
+            {
+                fprintf(stderr, "couldn't get a %s\n", kind.name);
+                return false;
+            }
+            size_t before = heapInUse();
+            auto page     = kind.parse(body);
+            size_t heap   = heapInUse() - before;
+            if (!page)
+            {
+                fprintf(stderr, "the %s didn't parse\n", kind.name);
+                return false;
+            }
+            printf("memory per cached %s: %zu Pokémon, %zu bytes decoded (%s), %zu bytes of JSON, %zu bytes stored\n", kind.name,
+                page->size(), heap ? heap : footprint(*page), heap ? "heap" : "estimated", body.size(), page->serialize().size());
+        }
+        return true;
+    }
+
+    bool pageFlips()
+    {
+        auto start = Clock::now();
+        CloudAccess access(options.cachedPages, options.prefetch);
+        if (!access.good())
+        {
+            fprintf(stderr, "couldn't load the first page from %s\n", options.server.c_str());
+            return false;
+        }
+        printf("first page: %.1f ms, %d pages\n", ms(Clock::now() - start), access.pages());
+        summary("flips after lingering", flip(access, options.flips, true, std::chrono::milliseconds(options.linger)));
+        summary("flips back", flip(access, options.flips / 2, false, std::chrono::milliseconds(options.linger)));
+        summary("rapid flips", flip(access, options.flips, true, std::chrono::milliseconds(0)));
+        summary("longest frame after a sort change", sortChanges(access, 6));
+        fetchSummary("page flips");
+
+        start = Clock::now();
+        GroupCloudAccess groups;
+        if (!groups.good())
+        {
+            fprintf(stderr, "couldn't load the first bundle page from %s\n", options.server.c_str());
+            return false;
+        }
+        printf("first bundle page: %.1f ms, %d pages\n", ms(Clock::now() - start), groups.pages());
+        summary("bundle flips after lingering", flip(groups, options.flips, true, std::chrono::milliseconds(options.linger)));
+        summary("rapid bundle flips", flip(groups, options.flips, true, std::chrono::milliseconds(0)));
+        return true;
+    }
+
+    // Uploads copies of what's on the first page, so that they're real Pokémon the server accepts
+    bool uploadThroughput()
+    {
+        std::string body;
+        std::unique_ptr<GPSSPage> page;
+        if (HttpCache::get(CloudAccess::makeURL(1, CloudAccess::LATEST, true, false, Generation::THREE, Generation::EIGHT, true), body) != 200 ||
+            !(page = GPSSPage::parse(body)) || page->size() == 0)
+        {
+            fprintf(stderr, "nothing to upload\n");
+            return false;
+        }
+        std::vector<std::shared_ptr<PKX>> batch;
+        size_t bytes = 0;
+        for (size_t i = 0; batch.size() < options.uploads && i < options.uploads * 2; i++)
+        {
+            if (auto pkm = page->pokemon()[i % page->size()])
+            {
+                bytes += pkm->getLength();
+                batch.emplace_back(pkm);
+            }
+        }
+        if (batch.empty())
+        {
+            fprintf(stderr, "no Pokémon on the first page could be read back\n");
+            return false;
+        }
+
+        bool ret = true;
+        for (size_t concurrency : options.concurrency)
+        {
+            Fetch::maxConcurrent(Fetch::Priority::BACKGROUND, concurrency);
+            GPSSUpload::init();
+            GPSSUpload::maxConcurrent(concurrency);
+            auto start = Clock::now();
+            GPSSUpload::queue(batch);
+            while (GPSSUpload::pending() > 0 && Clock::now() - start < std::chrono::seconds(120))
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            double seconds = ms(Clock::now() - start) / 1000;
+            size_t left    = GPSSUpload::pending();
+            GPSSUpload::exit();
+            if (left > 0)
+            {
+                fprintf(stderr, "%zu uploads didn't go through\n", left);
+                ret = false;
+            }
+            printf("uploads, %zu at a time: %zu in %.2f s, %.1f per second, %.0f bytes per second\n", concurrency, batch.size() - left, seconds,
+                (batch.size() - left) / seconds, bytes / seconds);
+        }
+        fetchSummary("uploads");
+        // Back to what PKSM runs with
+        Fetch::maxConcurrent(Fetch::Priority::BACKGROUND, 1);
+        return ret;
+    }
+
+    std::vector<size_t> parseList(const std::string& str)
+    {
+        std::vector<size_t> ret;
+        for (size_t pos = 0; pos < str.size();)
+        {
+            size_t comma = std::min(str.find(',', pos), str.size());
+            ret.push_back(std::max(strtoull(str.substr(pos, comma - pos).c_str(), nullptr, 10), 1ull));
+            pos = comma + 1;
+        }
+        return ret;
+    }
+
+    bool parseArgs(int argc, char** argv)
+    {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string arg = argv[i], value = argv[i + 1];
+            if (arg == "--server")
+            {
+                options.server = value;
+            }
+            else if (arg == "--flips")
+            {
+                options.flips = atoi(value.c_str());
+            }
+            else if (arg == "--linger")
+            {
+                options.linger = atoi(value.c_str());
+            }
+            else if (arg == "--cached-pages")
+            {
+                options.cachedPages = strtoull(value.c_str(), nullptr, 10);
+            }
+            else if (arg == "--prefetch")
+            {
+                options.prefetch = strtoull(value.c_str(), nullptr, 10);
+            }
+            else if (arg == "--uploads")
+            {
+                options.uploads = strtoull(value.c_str(), nullptr, 10);
+            }
+            else if (arg == "--concurrency")
+            {
+                options.concurrency = parseList(value);
+            }
+            else if (arg == "--metrics")
+            {
+                options.metrics = value;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return argc % 2 == 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (!parseArgs(argc, argv))
+    {
+        fprintf(stderr, "usage: %s [--server url] [--flips n] [--linger ms] [--cached-pages n] [--prefetch n] [--uploads n] [--concurrency 1,2,4] "
+                        "[--metrics file]\n",
+            argv[0]);
+        return 1;
+    }
+    curl_global_init(CURL_GLOBAL_ALL);
+    Configuration::getInstance().gpssServer(options.server);
+    if (Fetch::initMulti() != 0)
+    {
+        fprintf(stderr, "couldn't start Fetch\n");
+        return 1;
+    }
+
+    bool good = pageMemory() && pageFlips();
+    good      = good && uploadThroughput();
+    if (!options.metrics.empty())
+    {
+        Fetch::dumpMetrics(options.metrics);
+    }
+
+    Fetch::exitMulti();
+    curl_global_cleanup();
+    return good ? 0 : 1;
+}
@@ -0,0 +1,331 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+// Checks the mystery gift delta update against the stand-in server. It converts a small generated gift database, publishes a changed
+// version of it the way the EventsGalleryPacker does (a manifest, and every card under cards/ by its hash) into the directory the
+// server serves as /static/other/gifts/, and runs GiftDelta::apply on it. It checks that:
+//  - only the cards the local database doesn't have are downloaded, at background priority, and the rebuilt data is exactly the
+//    published data
+//  - a missing card, a corrupt card, a stale or truncated manifest, or too many changed cards make it fail without downloading more
+//    than it has to and without leaving anything behind, which is what sends the updater on to the full download
+// make check starts the stand-in and runs this against it. Run it as
+//     gpss-deltacheck --gifts dir [--server http://127.0.0.1:8080]
+// where dir is what the server was given as --gifts. It exits with 1 if any check fails
+
+#include "GiftDB.hpp"
+#include "GiftDelta.hpp"
+#include "fetch.hpp"
+#include "nlohmann/json.hpp"
+#include "sha256.h"
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        std::string server = "http://127.0.0.1:8080";
+        std::string gifts;
+    };
+
+    Options options;
+    constexpr size_t CARDS     = 16;
+    constexpr size_t CARD_SIZE = 264;
+    std::mt19937 rng(47);
+    int failures = 0;
+
+    void check(bool ok, const std::string& what)
+    {
+        printf("%s: %s\n", ok ? "ok" : "FAILED", what.c_str());
+        failures += ok ? 0 : 1;
+    }
+
+    std::vector<u8> randomCard(void)
+    {
+        std::vector<u8> ret(CARD_SIZE);
+        for (u8& byte : ret)
+        {
+            byte = rng();
+        }
+        return ret;
+    }
+
+    std::vector<u8> join(const std::vector<std::vector<u8>>& cards)
+    {
+        std::vector<u8> ret;
+        for (auto& card : cards)
+        {
+            ret.insert(ret.end(), card.begin(), card.end());
+        }
+        return ret;
+    }
+
+    std::string hex(const u8* data, size_t size)
+    {
+        std::string ret;
+        char digits[3];
+        for (size_t i = 0; i < size; i++)
+        {
+            snprintf(digits, sizeof(digits), "%02x", data[i]);
+            ret += digits;
+        }
+        return ret;
+    }
+
+    bool write(const std::string& path, const void* data, size_t size)
+    {
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f)
+        {
+            return false;
+        }
+        bool ok = fwrite(data, 1, size, f) == size;
+        return fclose(f) == 0 && ok;
+    }
+
+    std::vector<u8> read(const std::string& path)
+    {
+        std::vector<u8> ret;
+        if (FILE* f = fopen(path.c_str(), "rb"))
+        {
+            u8 chunk[4096];
+            size_t got;
+            while ((got = fread(chunk, 1, sizeof(chunk), f)) > 0)
+            {
+                ret.insert(ret.end(), chunk, chunk + got);
+            }
+            fclose(f);
+        }
+        return ret;
+    }
+
+    bool exists(const std::string& path)
+    {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0;
+    }
+
+    // A sheet like the packer's for cards laid out one after the other, each an event of its own
+    bool writeSheet(const std::string& path, size_t cards)
+    {
+        nlohmann::json sheet = {{"gen", "7"}, {"wondercards", nlohmann::json::array()}, {"matches", nlohmann::json::array()}};
+        for (size_t i = 0; i < cards; i++)
+        {
+            sheet["wondercards"].push_back({{"type", "wc7"}, {"offset", i * CARD_SIZE}, {"size", CARD_SIZE}, {"name", "Card " + std::to_string(i)},
+                {"game", "SM"}, {"species", 25}, {"form", 0}});
+            sheet["matches"].push_back({{"ENG", i}});
+        }
+        std::string str = sheet.dump();
+        return write(path, str.data(), str.size());
+    }
+
+    // Publishes cards as the packer would, returning the manifest. The archive hash is made up, as nothing here is compressed
+    std::string publish(const std::vector<std::vector<u8>>& cards, u8* archiveHash)
+    {
+        std::vector<u8> data = join(cards);
+        GiftDB::ManifestHeader header{GiftDB::MANIFEST_MAGIC, GiftDB::MANIFEST_VERSION, {}, {}, u32(cards.size())};
+        sha256(header.dataHash, data.data(), data.size());
+        sha256(header.archiveHash, header.dataHash, sizeof(header.dataHash));
+        memcpy(archiveHash, header.archiveHash, sizeof(header.archiveHash));
+
+        std::string ret((const char*)&header, sizeof(header));
+        for (auto& card : cards)
+        {
+            GiftDB::ManifestCard entry;
+            sha256(entry.hash, card.data(), card.size());
+            entry.size = card.size();
+            write(options.gifts + "/cards/" + hex(entry.hash, sizeof(entry.hash)), card.data(), card.size());
+            ret.append((const char*)&entry, sizeof(entry));
+        }
+        return ret;
+    }
+
+    std::string cardPath(const std::vector<u8>& card)
+    {
+        u8 hash[SHA256_BLOCK_SIZE];
+        sha256(hash, card.data(), card.size());
+        return options.gifts + "/cards/" + hex(hash, sizeof(hash));
+    }
+
+    // Only the last requests are kept, but every case here makes few enough that counting them all works
+    size_t cardFetches(void)
+    {
+        size_t ret = 0;
+        for (auto& record : Fetch::recentMetrics())
+        {
+            ret += record.url.find("/static/other/gifts/cards/") != std::string::npos ? 1 : 0;
+        }
+        return ret;
+    }
+
+    // So that they can't hold up browsing GPSS while the update runs
+    bool allBackground(void)
+    {
+        for (auto& record : Fetch::recentMetrics())
+        {
+            if (record.url.find("/static/other/gifts/cards/") != std::string::npos && record.priority != Fetch::Priority::BACKGROUND)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    struct Run
+    {
+        bool applied;
+        size_t fetched;
+    };
+
+    Run apply(const std::string& manifest, const u8* archiveHash, const std::string& dbPath, const std::string& outPath)
+    {
+        size_t before = cardFetches();
+        bool applied  = GiftDelta::apply(manifest, archiveHash, dbPath, options.server + "/static/other/gifts/cards/", outPath);
+        return {applied, cardFetches() - before};
+    }
+
+    // What the updater is left with when a delta fails: whatever was at outPath before, and no partial file
+    void checkFailure(const std::string& what, const Run& run, size_t maxFetched, const std::string& outPath, const std::vector<u8>& before)
+    {
+        check(!run.applied, what + " fails");
+        check(run.fetched <= maxFetched, what + " downloads " + std::to_string(run.fetched) + " cards, at most " + std::to_string(maxFetched));
+        check(read(outPath) == before && !exists(outPath + ".part"), what + " leaves the previous data alone");
+    }
+
+    void runChecks(void)
+    {
+        const std::string dir     = options.gifts;
+        const std::string dbPath  = dir + "/gifts7.db";
+        const std::string outPath = dir + "/data7.bin";
+        mkdir((dir + "/cards").c_str(), 0777);
+        remove(outPath.c_str());
+
+        std::vector<std::vector<u8>> local(CARDS);
+        for (auto& card : local)
+        {
+            card = randomCard();
+        }
+        std::vector<u8> localData = join(local);
+        bool converted = writeSheet(dir + "/sheet7.json", CARDS) && write(dir + "/local7.bin", localData.data(), localData.size()) &&
+                         GiftDB::convert(dir + "/sheet7.json", dir + "/local7.bin", dbPath);
+        check(converted, "local database converts");
+        if (!converted)
+        {
+            return;
+        }
+
+        // A quarter of the cards is as many as it's willing to download
+        std::vector<std::vector<u8>> changed = local;
+        for (size_t i : {1, 6, 9, 14})
+        {
+            changed[i] = randomCard();
+        }
+        u8 archiveHash[SHA256_BLOCK_SIZE];
+        std::string manifest = publish(changed, archiveHash);
+        Run run              = apply(manifest, archiveHash, dbPath, outPath);
+        check(run.applied, "delta with 4 of 16 cards changed applies");
+        check(run.fetched == 4, "it downloads only the 4 changed cards, downloaded " + std::to_string(run.fetched));
+        check(allBackground(), "the cards are downloaded at background priority");
+        check(read(outPath) == join(changed), "the rebuilt data is the published data");
+        GiftDB::Database rebuilt;
+        check(GiftDB::convert(dir + "/sheet7.json", outPath, dir + "/rebuilt7.db") && rebuilt.open(dir + "/rebuilt7.db") &&
+                  rebuilt.cards() == CARDS && rebuilt.data(6) == changed[6] && rebuilt.data(7) == local[7],
+            "the rebuilt data converts and reads back");
+        rebuilt.close();
+        std::vector<u8> good = read(outPath);
+
+        run = apply(publish(local, archiveHash), archiveHash, dbPath, outPath);
+        check(run.applied && run.fetched == 0 && read(outPath) == localData, "an unchanged archive downloads nothing");
+        write(outPath, good.data(), good.size());
+
+        u8 staleHash[SHA256_BLOCK_SIZE];
+        memcpy(staleHash, archiveHash, sizeof(staleHash));
+        staleHash[0] ^= 1;
+        manifest = publish(changed, archiveHash);
+        checkFailure("a manifest for another archive", apply(manifest, staleHash, dbPath, outPath), 0, outPath, good);
+        checkFailure("a truncated manifest", apply(manifest.substr(0, manifest.size() - 1), archiveHash, dbPath, outPath), 0, outPath, good);
+
+        remove(cardPath(changed[9]).c_str());
+        checkFailure("a missing card", apply(manifest, archiveHash, dbPath, outPath), 4, outPath, good);
+
+        manifest                = publish(changed, archiveHash);
+        std::vector<u8> corrupt = changed[14];
+        corrupt[0] ^= 1;
+        write(cardPath(changed[14]), corrupt.data(), corrupt.size());
+        checkFailure("a corrupt card", apply(manifest, archiveHash, dbPath, outPath), 4, outPath, good);
+
+        changed[3] = randomCard();
+        manifest   = publish(changed, archiveHash);
+        checkFailure("5 of 16 cards changed", apply(manifest, archiveHash, dbPath, outPath), 0, outPath, good);
+    }
+
+    bool parseArgs(int argc, char** argv)
+    {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string arg = argv[i], value = argv[i + 1];
+            if (arg == "--server")
+            {
+                options.server = value;
+            }
+            else if (arg == "--gifts")
+            {
+                options.gifts = value;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return argc % 2 == 1 && !options.gifts.empty();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (!parseArgs(argc, argv))
+    {
+        fprintf(stderr, "usage: %s --gifts dir [--server url]\n", argv[0]);
+        return 1;
+    }
+    curl_global_init(CURL_GLOBAL_ALL);
+    if (Fetch::initMulti() != 0)
+    {
+        fprintf(stderr, "couldn't start Fetch\n");
+        return 1;
+    }
+
+    runChecks();
+
+    Fetch::exitMulti();
+    curl_global_cleanup();
+    printf("%s\n", failures == 0 ? "all checks passed" : (std::to_string(failures) + " checks failed").c_str());
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+// The settings the cloud code reads, held in memory and set by whatever runs it
+
+#ifndef CONFIGURATION_HPP
+#define CONFIGURATION_HPP
+
+#include <string>
+
+class Configuration
+{
+public:
+    static Configuration& getInstance(void)
+    {
+        static Configuration config;
+        return config;
+    }
+
+    std::string patronCode(void) const { return mPatronCode; }
+    std::string gpssServer(void) const { return mGpssServer; }
+    void patronCode(const std::string& value) { mPatronCode = value; }
+    void gpssServer(const std::string& value) { mGpssServer = value; }
+
+private:
+    Configuration(void) = default;
+    std::string mPatronCode;
+    std::string mGpssServer = "http://127.0.0.1:8080";
+};
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+// Just enough of a Pokémon for the cloud code: its generation and its bytes. The harness never edits or displays them, so nothing is
+// decrypted or checked, and species is read from where every generation from 4 on keeps it in decrypted data
+
+#ifndef PKX_HPP
+#define PKX_HPP
+
+#include "generation.hpp"
+#include <memory>
+#include <vector>
+
+class PKX
+{
+public:
+    PKX(Generation gen, const u8* data, size_t length);
+
+    // Empty Pokémon of that generation when data is null, like PKSM-Core's
+    template <Generation gen>
+    static std::unique_ptr<PKX> getPKM(u8* data, bool directAccess = false)
+    {
+        return getPKM(gen, data, length(gen), directAccess);
+    }
+    static std::unique_ptr<PKX> getPKM(Generation gen, u8* data, size_t length, bool directAccess = false);
+    // Stored size of a Pokémon of that generation
+    static size_t length(Generation gen);
+
+    std::unique_ptr<PKX> clone() const { return std::make_unique<PKX>(gen, data.data(), data.size()); }
+    Generation generation() const { return gen; }
+    u16 species() const;
+    u8 level() const { return 1; }
+    bool shiny() const { return false; }
+    u8* rawData() { return data.data(); }
+    const u8* rawData() const { return data.data(); }
+    u32 getLength() const { return data.size(); }
+
+private:
+    Generation gen;
+    std::vector<u8> data;
+};
+
+#endif
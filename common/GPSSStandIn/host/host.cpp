@@ -0,0 +1,122 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#include "PKX.hpp"
+#include "thread.hpp"
+#include <algorithm>
+#include <thread>
+
+std::string genToString(Generation gen)
+{
+    switch (gen)
+    {
+        case Generation::THREE:
+            return "3";
+        case Generation::FOUR:
+            return "4";
+        case Generation::FIVE:
+            return "5";
+        case Generation::SIX:
+            return "6";
+        case Generation::SEVEN:
+            return "7";
+        case Generation::LGPE:
+            return "LGPE";
+        case Generation::EIGHT:
+            return "8";
+        case Generation::UNUSED:
+            break;
+    }
+    return "INVALID";
+}
+
+Generation stringToGen(const std::string& str)
+{
+    for (Generation gen : {Generation::THREE, Generation::FOUR, Generation::FIVE, Generation::SIX, Generation::SEVEN, Generation::LGPE,
+             Generation::EIGHT})
+    {
+        if (str == genToString(gen))
+        {
+            return gen;
+        }
+    }
+    return Generation::UNUSED;
+}
+
+PKX::PKX(Generation gen, const u8* data, size_t length) : gen(gen), data(length)
+{
+    if (data)
+    {
+        std::copy(data, data + length, this->data.begin());
+    }
+}
+
+std::unique_ptr<PKX> PKX::getPKM(Generation gen, u8* data, size_t length, bool)
+{
+    if (length == 0 || length != PKX::length(gen))
+    {
+        return nullptr;
+    }
+    return std::make_unique<PKX>(gen, data, length);
+}
+
+size_t PKX::length(Generation gen)
+{
+    switch (gen)
+    {
+        case Generation::THREE:
+            return 80;
+        case Generation::FOUR:
+        case Generation::FIVE:
+            return 136;
+        case Generation::SIX:
+        case Generation::SEVEN:
+            return 232;
+        case Generation::LGPE:
+            return 260;
+        case Generation::EIGHT:
+            return 344;
+        case Generation::UNUSED:
+            break;
+    }
+    return 0;
+}
+
+u16 PKX::species() const
+{
+    return data.size() >= 10 ? data[8] | (data[9] << 8) : 0;
+}
+
+void Threads::init(void) {}
+
+// Stack sizes and background priorities only matter on the 3DS
+bool Threads::create(void (*entrypoint)(void*), void* arg, std::optional<size_t>, bool)
+{
+    std::thread(entrypoint, arg).detach();
+    return true;
+}
+
+void Threads::exit(void) {}
@@ -0,0 +1,49 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+// newlib's lock and condition API, on top of pthreads, for building the shared code on a desktop
+
+#ifndef SYS_LOCK_H
+#define SYS_LOCK_H
+
+#include <pthread.h>
+
+typedef pthread_mutex_t _LOCK_T;
+
+#define __lock_init(lock) pthread_mutex_init(&(lock), NULL)
+#define __lock_acquire(lock) pthread_mutex_lock(&(lock))
+#define __lock_release(lock) pthread_mutex_unlock(&(lock))
+#define __lock_close(lock) pthread_mutex_destroy(&(lock))
+
+typedef pthread_cond_t _COND_T;
+
+#define __COND_INITIALIZER PTHREAD_COND_INITIALIZER
+#define __cond_signal(cond) pthread_cond_signal(&(cond))
+#define __cond_broadcast(cond) pthread_cond_broadcast(&(cond))
+// newlib takes a timeout in nanoseconds, UINT64_MAX being forever; nothing here waits with one
+#define __cond_wait(cond, lock, timeout) pthread_cond_wait(&(cond), &(lock))
+
+#endif
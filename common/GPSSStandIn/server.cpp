@@ -0,0 +1,1011 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+// Stand-in for the parts of flagbrew.org PKSM talks to: the GPSS page and bundle listings, sharing, downloading and the download counters,
+// plus the mystery gift files. Point PKSM's gpssServer setting, or the benchmark, at it to run the cloud code without the real server.
+// Pokémon come from a fixture file, or are made up from a seed, and shared ones join them, so totals and pages move the way they do on
+// the real thing. Listings carry ETags, and gift files answer Range requests, so caching and resuming can be exercised too.
+// Latency, jitter, dropped connections and a bandwidth cap can be added to every response, and every request is logged with its timing.
+// Build it with make in this directory, and run it as
+//     gpss-standin [--port 8080] [--fixtures fixtures/gpss.json | --generate count] [--dump file] [--gifts dir] [--latency ms]
+//         [--jitter ms] [--loss fraction] [--bandwidth bytes/s] [--seed n] [--quiet]
+// --dump writes the Pokémon it would serve, in the fixture format, to a file and exits. fixtures/gpss.json was made with
+//     gpss-standin --generate 120 --dump fixtures/gpss.json
+
+#include "base64.hpp"
+#include "nlohmann/json.hpp"
+#include "types.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <random>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        int port = 8080;
+        std::string fixtures;
+        size_t generate = 0;
+        std::string dump;
+        std::string gifts;
+        int latency      = 0;
+        int jitter       = 0;
+        double loss      = 0;
+        size_t bandwidth = 0;
+        unsigned seed    = 1;
+        bool quiet       = false;
+    };
+
+    struct Pokemon
+    {
+        std::string base64;
+        std::string generation;
+        bool legal;
+        std::string code;
+        // Upload order, which is what "latest" sorts by
+        size_t uploaded;
+        size_t downloads;
+    };
+
+    struct Bundle
+    {
+        std::string code;
+        std::vector<size_t> members;
+        size_t uploaded;
+        size_t downloads;
+    };
+
+    struct Request
+    {
+        std::string method;
+        std::string path;
+        std::map<std::string, std::string> query;
+        // Names are lowercased
+        std::map<std::string, std::string> headers;
+        std::string body;
+        bool keepAlive = true;
+
+        std::string header(const std::string& name) const
+        {
+            auto found = headers.find(name);
+            return found == headers.end() ? "" : found->second;
+        }
+        std::string param(const std::string& name, const std::string& fallback = "") const
+        {
+            auto found = query.find(name);
+            return found == query.end() ? fallback : found->second;
+        }
+        int intParam(const std::string& name, int fallback) const
+        {
+            std::string value = param(name);
+            return value.empty() ? fallback : atoi(value.c_str());
+        }
+    };
+
+    struct Response
+    {
+        int status       = 200;
+        std::string type = "application/json";
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::string body;
+        // Set to leave out the body, as for 304s
+        bool noBody = false;
+    };
+
+    constexpr size_t MAX_HEAD = 64 * 1024;
+    constexpr size_t MAX_BODY = 16 * 1024 * 1024;
+
+    Options options;
+    std::mutex poolMutex;
+    std::vector<Pokemon> pokemon;
+    std::vector<Bundle> bundles;
+    size_t uploads = 0;
+    std::mt19937 rng;
+    std::mutex rngMutex;
+
+    template <typename T>
+    T random(T low, T high)
+    {
+        std::lock_guard<std::mutex> lock(rngMutex);
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            return std::uniform_real_distribution<T>(low, high)(rng);
+        }
+        else
+        {
+            return std::uniform_int_distribution<T>(low, high)(rng);
+        }
+    }
+
+    bool startsWith(const std::string& str, const std::string& prefix)
+    {
+        return str.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    std::string newCode()
+    {
+        std::string ret;
+        for (int i = 0; i < 10; i++)
+        {
+            ret += char('0' + random(0, 9));
+        }
+        return ret;
+    }
+
+    // Stored size of a Pokémon of a generation, as GPSS spells them, or 0 for anything GPSS doesn't take
+    size_t pkmLength(const std::string& gen)
+    {
+        if (gen == "4" || gen == "5")
+        {
+            return 136;
+        }
+        if (gen == "6" || gen == "7")
+        {
+            return 232;
+        }
+        if (gen == "LGPE")
+        {
+            return 260;
+        }
+        if (gen == "8")
+        {
+            return 344;
+        }
+        return 0;
+    }
+
+    // Numeric generations are filtered by min_gen and max_gen, and Let's Go by lgpe alone
+    bool inRange(const std::string& gen, int low, int high, bool lgpe)
+    {
+        return gen == "LGPE" ? lgpe : atoi(gen.c_str()) >= low && atoi(gen.c_str()) <= high;
+    }
+
+    // A decrypted Pokémon with a random species and trainer, and a correct checksum, so that PKSM shows it like a real one
+    std::string makePokemon(const std::string& gen)
+    {
+        static const std::map<std::string, int> maxSpecies = {{"4", 493}, {"5", 649}, {"6", 721}, {"7", 807}, {"LGPE", 151}, {"8", 898}};
+        std::vector<u8> data(pkmLength(gen));
+        u32 encryptionConstant = random<u32>(0, UINT32_MAX);
+        u16 species            = random(1, maxSpecies.at(gen));
+        u16 tid                = random<u16>(0, UINT16_MAX);
+        u16 sid                = random<u16>(0, UINT16_MAX);
+        u32 level              = random(1, 100);
+        u32 exp                = level * level * level;
+        memcpy(data.data(), &encryptionConstant, sizeof(encryptionConstant));
+        memcpy(data.data() + 0x08, &species, sizeof(species));
+        memcpy(data.data() + 0x0C, &tid, sizeof(tid));
+        memcpy(data.data() + 0x0E, &sid, sizeof(sid));
+        memcpy(data.data() + 0x10, &exp, sizeof(exp));
+        // Everything after the header up to the end of the stored data, except that Let's Go leaves its extra bytes out
+        size_t checksummed = gen == "LGPE" ? 0xE8 : data.size();
+        u16 checksum       = 0;
+        for (size_t i = 0x08; i < checksummed; i += 2)
+        {
+            checksum += data[i] | (data[i + 1] << 8);
+        }
+        memcpy(data.data() + 0x06, &checksum, sizeof(checksum));
+        return base64_encode(data.data(), data.size());
+    }
+
+    void generate(size_t count)
+    {
+        static const std::vector<std::string> gens = {"4", "5", "6", "7", "7", "7", "LGPE", "8"};
+        for (size_t i = 0; i < count; i++)
+        {
+            std::string gen = gens[random<size_t>(0, gens.size() - 1)];
+            pokemon.push_back({makePokemon(gen), gen, random(0, 9) < 7, newCode(), uploads++, random<size_t>(0, 500)});
+        }
+        for (size_t i = 0; count > 0 && i < count / 5; i++)
+        {
+            Bundle bundle{newCode(), {}, uploads++, random<size_t>(0, 200)};
+            for (int j = random(2, 6); j > 0; j--)
+            {
+                bundle.members.push_back(random<size_t>(0, count - 1));
+            }
+            bundles.emplace_back(std::move(bundle));
+        }
+    }
+
+    std::optional<std::string> readFile(const std::string& path)
+    {
+        FILE* in = fopen(path.c_str(), "rb");
+        if (!in)
+        {
+            return std::nullopt;
+        }
+        std::string ret;
+        char buffer[0x4000];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        {
+            ret.append(buffer, read);
+        }
+        fclose(in);
+        return ret;
+    }
+
+    bool loadFixtures(const std::string& path)
+    {
+        auto data = readFile(path);
+        if (!data)
+        {
+            return false;
+        }
+        nlohmann::json json = nlohmann::json::parse(*data, nullptr, false);
+        if (!json.is_object() || !json.contains("pokemon") || !json["pokemon"].is_array())
+        {
+            return false;
+        }
+        std::map<std::string, size_t> byCode;
+        for (auto& mon : json["pokemon"])
+        {
+            std::string gen = mon.value("generation", "");
+            if (pkmLength(gen) == 0 || !mon.contains("base_64") || !mon["base_64"].is_string())
+            {
+                return false;
+            }
+            std::string code = mon.value("code", newCode());
+            byCode[code]     = pokemon.size();
+            pokemon.push_back({mon["base_64"].get<std::string>(), gen, mon.value("legal", false), code, uploads++, mon.value("downloads", (size_t)0)});
+        }
+        if (json.contains("bundles") && json["bundles"].is_array())
+        {
+            for (auto& group : json["bundles"])
+            {
+                Bundle bundle{group.value("code", newCode()), {}, uploads++, group.value("downloads", (size_t)0)};
+                for (auto& member : group.value("members", nlohmann::json::array()))
+                {
+                    if (!member.is_string() || !byCode.count(member.get<std::string>()))
+                    {
+                        return false;
+                    }
+                    bundle.members.push_back(byCode[member.get<std::string>()]);
+                }
+                bundles.emplace_back(std::move(bundle));
+            }
+        }
+        return true;
+    }
+
+    bool dumpFixtures(const std::string& path)
+    {
+        nlohmann::json json = {{"pokemon", nlohmann::json::array()}, {"bundles", nlohmann::json::array()}};
+        for (auto& mon : pokemon)
+        {
+            json["pokemon"].push_back(
+                {{"base_64", mon.base64}, {"generation", mon.generation}, {"legal", mon.legal}, {"code", mon.code}, {"downloads", mon.downloads}});
+        }
+        for (auto& bundle : bundles)
+        {
+            nlohmann::json members = nlohmann::json::array();
+            for (size_t member : bundle.members)
+            {
+                members.push_back(pokemon[member].code);
+            }
+            json["bundles"].push_back({{"code", bundle.code}, {"members", members}, {"downloads", bundle.downloads}});
+        }
+        FILE* out = fopen(path.c_str(), "wb");
+        if (!out)
+        {
+            return false;
+        }
+        std::string data = json.dump(1);
+        fwrite(data.data(), 1, data.size(), out);
+        fclose(out);
+        return true;
+    }
+
+    // Sorted the way the listing asked for: by upload order for latest, by downloads for popular, newest or most downloaded first unless
+    // dir is ascend
+    template <typename T>
+    void sortListing(std::vector<const T*>& items, const Request& request)
+    {
+        bool popular = request.param("sort") == "popular";
+        bool ascend  = request.param("dir") == "ascend";
+        std::stable_sort(items.begin(), items.end(), [popular, ascend](const T* a, const T* b) {
+            size_t first  = popular ? a->downloads : a->uploaded;
+            size_t second = popular ? b->downloads : b->uploaded;
+            return ascend ? first < second : first > second;
+        });
+    }
+
+    nlohmann::json pokemonJson(const Pokemon& mon, const char* dataKey)
+    {
+        return {{dataKey, mon.base64}, {"generation", mon.generation}, {"legal", mon.legal}, {"code", mon.code}, {"download_count", mon.downloads}};
+    }
+
+    bool legalOnly(const Request& request)
+    {
+        std::string value = request.param("legal_only");
+        return value == "True" || value == "true" || value == "yes";
+    }
+
+    // Pages past the last one come back empty, like they do from the real server
+    Response listPokemon(const Request& request)
+    {
+        int low   = request.intParam("min_gen", 1);
+        int high  = request.intParam("max_gen", 8);
+        bool lgpe = request.param("lgpe", "yes") == "yes";
+        bool legal = legalOnly(request);
+        int count  = std::clamp(request.intParam("count", 30), 1, 100);
+        int number = std::max(request.intParam("page", 1), 1);
+
+        std::lock_guard<std::mutex> lock(poolMutex);
+        std::vector<const Pokemon*> matches;
+        for (auto& mon : pokemon)
+        {
+            if (inRange(mon.generation, low, high, lgpe) && (!legal || mon.legal))
+            {
+                matches.push_back(&mon);
+            }
+        }
+        sortListing(matches, request);
+
+        nlohmann::json results = nlohmann::json::array();
+        for (size_t i = size_t(number - 1) * count; i < matches.size() && i < size_t(number) * count; i++)
+        {
+            results.push_back(pokemonJson(*matches[i], "base_64"));
+        }
+        int pages = std::max(((int)matches.size() + count - 1) / count, 1);
+        return {200, "application/json", {}, nlohmann::json{{"total_pkm", matches.size()}, {"pages", pages}, {"page", number}, {"results", results}}.dump()};
+    }
+
+    Response listBundles(const Request& request)
+    {
+        int low    = request.intParam("min_gen", 1);
+        int high   = request.intParam("max_gen", 8);
+        bool lgpe  = request.param("lgpe", "yes") == "yes";
+        bool legal = legalOnly(request);
+        int count  = std::clamp(request.intParam("count", 5), 1, 100);
+        int number = std::max(request.intParam("page", 1), 1);
+
+        std::lock_guard<std::mutex> lock(poolMutex);
+        std::vector<const Bundle*> matches;
+        for (auto& bundle : bundles)
+        {
+            if (std::all_of(bundle.members.begin(), bundle.members.end(), [&](size_t member) {
+                    return inRange(pokemon[member].generation, low, high, lgpe) && (!legal || pokemon[member].legal);
+                }))
+            {
+                matches.push_back(&bundle);
+            }
+        }
+        sortListing(matches, request);
+
+        nlohmann::json results = nlohmann::json::array();
+        for (size_t i = size_t(number - 1) * count; i < matches.size() && i < size_t(number) * count; i++)
+        {
+            nlohmann::json members = nlohmann::json::array();
+            for (size_t member : matches[i]->members)
+            {
+                members.push_back(pokemonJson(pokemon[member], "base64"));
+            }
+            results.push_back({{"code", matches[i]->code}, {"download_count", matches[i]->downloads}, {"pokemon", members}});
+        }
+        int pages = std::max(((int)matches.size() + count - 1) / count, 1);
+        return {200, "application/json", {}, nlohmann::json{{"total_bundles", matches.size()}, {"pages", pages}, {"page", number}, {"results", results}}.dump()};
+    }
+
+    // Multipart parts by name. The boundary comes from the Content-Type, or failing that from the body's first line
+    std::map<std::string, std::string> multipart(const Request& request)
+    {
+        std::map<std::string, std::string> ret;
+        std::string type = request.header("content-type");
+        std::string boundary;
+        size_t pos = type.find("boundary=");
+        if (pos != std::string::npos)
+        {
+            boundary = type.substr(pos + 9);
+            boundary = boundary.substr(0, boundary.find(';'));
+            boundary.erase(std::remove(boundary.begin(), boundary.end(), '"'), boundary.end());
+        }
+        else if (request.body.compare(0, 2, "--") == 0)
+        {
+            boundary = request.body.substr(2, request.body.find("\r\n") - 2);
+        }
+        if (boundary.empty())
+        {
+            return ret;
+        }
+
+        const std::string delimiter = "--" + boundary;
+        pos                         = request.body.find(delimiter);
+        while (pos != std::string::npos)
+        {
+            pos += delimiter.size();
+            if (request.body.compare(pos, 2, "--") == 0)
+            {
+                break;
+            }
+            size_t headEnd = request.body.find("\r\n\r\n", pos);
+            size_t next    = request.body.find("\r\n" + delimiter, pos);
+            if (headEnd == std::string::npos || next == std::string::npos || headEnd > next)
+            {
+                break;
+            }
+            std::string head = request.body.substr(pos, headEnd - pos);
+            size_t name      = head.find("name=\"");
+            if (name != std::string::npos)
+            {
+                name += 6;
+                ret[head.substr(name, head.find('"', name) - name)] = request.body.substr(headEnd + 4, next - headEnd - 4);
+            }
+            pos = next + 2;
+        }
+        return ret;
+    }
+
+    Response share(const Request& request)
+    {
+        auto parts = multipart(request);
+        std::vector<std::pair<std::string, std::string>> mons;
+        bool isBundle = request.header("bundle") == "yes";
+        if (isBundle)
+        {
+            int amount = atoi(request.header("amount").c_str());
+            std::string gens = request.header("generations");
+            if (amount < 2 || amount > 6)
+            {
+                return {400, "text/plain", {}, "bundles hold 2 to 6 Pokémon"};
+            }
+            for (int i = 1; i <= amount; i++)
+            {
+                std::string gen = gens.substr(0, gens.find(','));
+                gens            = gens.find(',') == std::string::npos ? "" : gens.substr(gens.find(',') + 1);
+                auto found      = parts.find("pkmn" + std::to_string(i));
+                if (found == parts.end())
+                {
+                    return {400, "text/plain", {}, "missing pkmn" + std::to_string(i)};
+                }
+                mons.emplace_back(gen, found->second);
+            }
+        }
+        else
+        {
+            auto found = parts.find("pkmn");
+            if (found == parts.end())
+            {
+                return {400, "text/plain", {}, "missing pkmn"};
+            }
+            mons.emplace_back(request.header("generation"), found->second);
+        }
+        for (auto& [gen, data] : mons)
+        {
+            if (pkmLength(gen) == 0 || data.size() != pkmLength(gen))
+            {
+                return {400, "text/plain", {}, "not a generation " + gen + " Pokémon"};
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(poolMutex);
+        Bundle bundle{newCode(), {}, 0, 0};
+        for (auto& [gen, data] : mons)
+        {
+            bundle.members.push_back(pokemon.size());
+            pokemon.push_back({base64_encode(data.data(), data.size()), gen, true, newCode(), uploads++, 0});
+        }
+        if (isBundle)
+        {
+            bundle.uploaded = uploads++;
+            bundles.push_back(bundle);
+            return {201, "text/plain", {}, bundle.code};
+        }
+        return {201, "text/plain", {}, pokemon.back().code};
+    }
+
+    // Also what counts downloads
+    Response download(const std::string& code, bool isBundle)
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (isBundle)
+        {
+            for (auto& bundle : bundles)
+            {
+                if (bundle.code == code)
+                {
+                    bundle.downloads++;
+                    nlohmann::json members = nlohmann::json::array();
+                    for (size_t member : bundle.members)
+                    {
+                        members.push_back(pokemonJson(pokemon[member], "base64"));
+                    }
+                    return {200, "application/json", {}, nlohmann::json{{"code", code}, {"pokemon", members}}.dump()};
+                }
+            }
+        }
+        else
+        {
+            for (auto& mon : pokemon)
+            {
+                if (mon.code == code)
+                {
+                    mon.downloads++;
+                    return {200, "text/plain", {{"Generation", mon.generation}}, mon.base64};
+                }
+            }
+        }
+        return {404, "text/plain", {}, "no such code"};
+    }
+
+    // Files under --gifts, with ETags and single Range requests, which is all Fetch::download uses
+    Response gift(const Request& request, const std::string& name)
+    {
+        struct stat info;
+        std::string path = options.gifts + "/" + name;
+        if (options.gifts.empty() || name.find("..") != std::string::npos || stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+        {
+            return {404, "text/plain", {}, "not found"};
+        }
+        auto data = readFile(path);
+        if (!data)
+        {
+            return {500, "text/plain", {}, "unreadable"};
+        }
+
+        std::string etag = "\"" + std::to_string(info.st_size) + "-" + std::to_string(info.st_mtime) + "\"";
+        Response ret{200, "application/octet-stream", {{"ETag", etag}, {"Accept-Ranges", "bytes"}}, ""};
+        if (request.header("if-none-match") == etag)
+        {
+            ret.status = 304;
+            ret.noBody = true;
+            return ret;
+        }
+        std::string range = request.header("range");
+        std::string ifRange = request.header("if-range");
+        if (startsWith(range, "bytes=") && (ifRange.empty() || ifRange == etag))
+        {
+            size_t size  = data->size();
+            size_t start = strtoull(range.c_str() + 6, nullptr, 10);
+            size_t dash  = range.find('-');
+            size_t end   = dash + 1 < range.size() ? strtoull(range.c_str() + dash + 1, nullptr, 10) : size - 1;
+            if (start >= size || end < start)
+            {
+                return {416, "text/plain", {{"Content-Range", "bytes */" + std::to_string(size)}}, ""};
+            }
+            end = std::min(end, size - 1);
+            ret.status = 206;
+            ret.headers.emplace_back("Content-Range", "bytes " + std::to_string(start) + "-" + std::to_string(end) + "/" + std::to_string(size));
+            ret.body = data->substr(start, end - start + 1);
+            return ret;
+        }
+        ret.body = std::move(*data);
+        return ret;
+    }
+
+    // FNV-1a of the body, so that unchanged listings can be answered with a 304
+    std::string etagFor(const std::string& body)
+    {
+        u64 hash = 0xCBF29CE484222325;
+        for (char c : body)
+        {
+            hash = (hash ^ (u8)c) * 0x100000001B3;
+        }
+        char ret[20];
+        snprintf(ret, sizeof(ret), "\"%016llx\"", (unsigned long long)hash);
+        return ret;
+    }
+
+    Response handle(const Request& request)
+    {
+        const std::string& path = request.path;
+        Response ret;
+        if (request.method == "GET" && path == "/api/v1/gpss/all")
+        {
+            ret = listPokemon(request);
+        }
+        else if (request.method == "GET" && path == "/api/v1/gpss/bundles/all")
+        {
+            ret = listBundles(request);
+        }
+        else if (request.method == "POST" && path == "/gpss/share")
+        {
+            return share(request);
+        }
+        else if (request.method == "GET" && startsWith(path, "/gpss/download/bundle/"))
+        {
+            return download(path.substr(22), true);
+        }
+        else if (request.method == "GET" && startsWith(path, "/gpss/download/"))
+        {
+            return download(path.substr(15), false);
+        }
+        else if (request.method == "GET" && startsWith(path, "/static/other/gifts/"))
+        {
+            return gift(request, path.substr(20));
+        }
+        else
+        {
+            return {404, "text/plain", {}, "not found"};
+        }
+
+        std::string etag = etagFor(ret.body);
+        ret.headers.emplace_back("ETag", etag);
+        if (request.header("if-none-match") == etag)
+        {
+            ret.status = 304;
+            ret.noBody = true;
+        }
+        return ret;
+    }
+
+    const char* reason(int status)
+    {
+        switch (status)
+        {
+            case 100:
+                return "Continue";
+            case 200:
+                return "OK";
+            case 201:
+                return "Created";
+            case 206:
+                return "Partial Content";
+            case 304:
+                return "Not Modified";
+            case 400:
+                return "Bad Request";
+            case 404:
+                return "Not Found";
+            case 411:
+                return "Length Required";
+            case 413:
+                return "Payload Too Large";
+            case 416:
+                return "Range Not Satisfiable";
+            default:
+                return "Internal Server Error";
+        }
+    }
+
+    std::string urlDecode(const std::string& str)
+    {
+        std::string ret;
+        for (size_t i = 0; i < str.size(); i++)
+        {
+            if (str[i] == '%' && i + 2 < str.size())
+            {
+                ret += (char)strtol(str.substr(i + 1, 2).c_str(), nullptr, 16);
+                i += 2;
+            }
+            else
+            {
+                ret += str[i] == '+' ? ' ' : str[i];
+            }
+        }
+        return ret;
+    }
+
+    bool sendAll(int fd, const char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                return false;
+            }
+            data += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    // Holds to the bandwidth cap by sending a twentieth of a second's worth at a time
+    bool sendThrottled(int fd, const std::string& data)
+    {
+        if (options.bandwidth == 0)
+        {
+            return sendAll(fd, data.data(), data.size());
+        }
+        size_t chunk = std::max(options.bandwidth / 20, (size_t)1);
+        for (size_t pos = 0; pos < data.size(); pos += chunk)
+        {
+            auto start = std::chrono::steady_clock::now();
+            size_t size = std::min(chunk, data.size() - pos);
+            if (!sendAll(fd, data.data() + pos, size))
+            {
+                return false;
+            }
+            std::this_thread::sleep_until(start + std::chrono::microseconds(size * 1'000'000 / options.bandwidth));
+        }
+        return true;
+    }
+
+    // Reads one request off a kept-alive connection. Returns false once the connection is done
+    bool readRequest(int fd, std::string& buffer, Request& request)
+    {
+        size_t headEnd;
+        while ((headEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+        {
+            char chunk[0x4000];
+            ssize_t got = buffer.size() < MAX_HEAD ? recv(fd, chunk, sizeof(chunk), 0) : 0;
+            if (got <= 0)
+            {
+                return false;
+            }
+            buffer.append(chunk, got);
+        }
+
+        std::string head = buffer.substr(0, headEnd);
+        size_t lineEnd   = head.find("\r\n");
+        std::string line = head.substr(0, lineEnd);
+        size_t space     = line.find(' ');
+        size_t space2    = line.find(' ', space + 1);
+        if (space == std::string::npos || space2 == std::string::npos)
+        {
+            return false;
+        }
+        request.method     = line.substr(0, space);
+        std::string target = line.substr(space + 1, space2 - space - 1);
+        request.keepAlive  = line.compare(space2 + 1, std::string::npos, "HTTP/1.0") != 0;
+        size_t question    = target.find('?');
+        request.path       = urlDecode(target.substr(0, question));
+        if (question != std::string::npos)
+        {
+            std::string query = target.substr(question + 1);
+            size_t pos        = 0;
+            while (pos <= query.size())
+            {
+                size_t amp         = std::min(query.find('&', pos), query.size());
+                std::string pair   = query.substr(pos, amp - pos);
+                size_t equals      = pair.find('=');
+                request.query[urlDecode(pair.substr(0, equals))] = equals == std::string::npos ? "" : urlDecode(pair.substr(equals + 1));
+                pos                = amp + 1;
+            }
+        }
+        while (lineEnd != std::string::npos)
+        {
+            size_t next      = head.find("\r\n", lineEnd + 2);
+            std::string line = head.substr(lineEnd + 2, next == std::string::npos ? std::string::npos : next - lineEnd - 2);
+            size_t colon     = line.find(':');
+            if (colon != std::string::npos)
+            {
+                std::string name = line.substr(0, colon);
+                std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+                std::string value = line.substr(colon + 1);
+                value.erase(0, value.find_first_not_of(" \t"));
+                value.erase(value.find_last_not_of(" \t") + 1);
+                request.headers[name] = value;
+            }
+            lineEnd = next;
+        }
+        std::string connection = request.header("connection");
+        std::transform(connection.begin(), connection.end(), connection.begin(), ::tolower);
+        if (connection == "close")
+        {
+            request.keepAlive = false;
+        }
+        else if (connection == "keep-alive")
+        {
+            request.keepAlive = true;
+        }
+
+        size_t length = strtoull(request.header("content-length").c_str(), nullptr, 10);
+        buffer.erase(0, headEnd + 4);
+        if (length > MAX_BODY || (!request.header("transfer-encoding").empty() && request.header("transfer-encoding") != "identity"))
+        {
+            Response refused{length > MAX_BODY ? 413 : 411, "text/plain", {}, ""};
+            std::string response = "HTTP/1.1 " + std::to_string(refused.status) + " " + reason(refused.status) +
+                                   "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            sendAll(fd, response.data(), response.size());
+            return false;
+        }
+        if (buffer.size() < length && request.header("expect") == "100-continue")
+        {
+            const char continueLine[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            sendAll(fd, continueLine, sizeof(continueLine) - 1);
+        }
+        while (buffer.size() < length)
+        {
+            char chunk[0x4000];
+            ssize_t got = recv(fd, chunk, sizeof(chunk), 0);
+            if (got <= 0)
+            {
+                return false;
+            }
+            buffer.append(chunk, got);
+        }
+        request.body = buffer.substr(0, length);
+        buffer.erase(0, length);
+        return true;
+    }
+
+    void serve(int fd)
+    {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        timeval timeout = {30, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        std::string buffer;
+        Request request;
+        while (readRequest(fd, buffer, request))
+        {
+            auto start = std::chrono::steady_clock::now();
+            std::string target = request.path;
+            if (options.loss > 0 && random(0.0, 1.0) < options.loss)
+            {
+                if (!options.quiet)
+                {
+                    fprintf(stderr, "%s %s dropped\n", request.method.c_str(), target.c_str());
+                }
+                break;
+            }
+
+            Response response = handle(request);
+            int delay         = options.latency + (options.jitter > 0 ? random(0, options.jitter) : 0);
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+
+            std::string head = "HTTP/1.1 " + std::to_string(response.status) + " " + reason(response.status) + "\r\n";
+            head += "Content-Type: " + response.type + "\r\n";
+            for (auto& [name, value] : response.headers)
+            {
+                head += name + ": " + value + "\r\n";
+            }
+            head += "Content-Length: " + std::to_string(response.noBody ? 0 : response.body.size()) + "\r\n";
+            head += request.keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+            bool sent = response.noBody || request.method == "HEAD" ? sendAll(fd, head.data(), head.size())
+                                                                    : sendThrottled(fd, head + response.body);
+
+            if (!options.quiet)
+            {
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                fprintf(stderr, "%s %s%s %d %zu bytes %.1f ms\n", request.method.c_str(), target.c_str(), request.query.empty() ? "" : "?...",
+                    response.status, response.noBody ? 0 : response.body.size(), ms);
+            }
+            if (!sent || !request.keepAlive)
+            {
+                break;
+            }
+            request = Request{};
+        }
+        close(fd);
+    }
+
+    bool parseArgs(int argc, char** argv)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--quiet")
+            {
+                options.quiet = true;
+                continue;
+            }
+            if (i + 1 >= argc)
+            {
+                return false;
+            }
+            std::string value = argv[++i];
+            if (arg == "--port")
+            {
+                options.port = atoi(value.c_str());
+            }
+            else if (arg == "--fixtures")
+            {
+                options.fixtures = value;
+            }
+            else if (arg == "--generate")
+            {
+                options.generate = strtoull(value.c_str(), nullptr, 10);
+            }
+            else if (arg == "--dump")
+            {
+                options.dump = value;
+            }
+            else if (arg == "--gifts")
+            {
+                options.gifts = value;
+            }
+            else if (arg == "--latency")
+            {
+                options.latency = atoi(value.c_str());
+            }
+            else if (arg == "--jitter")
+            {
+                options.jitter = atoi(value.c_str());
+            }
+            else if (arg == "--loss")
+            {
+                options.loss = atof(value.c_str());
+            }
+            else if (arg == "--bandwidth")
+            {
+                options.bandwidth = strtoull(value.c_str(), nullptr, 10);
+            }
+            else if (arg == "--seed")
+            {
+                options.seed = strtoul(value.c_str(), nullptr, 10);
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (!parseArgs(argc, argv))
+    {
+        fprintf(stderr, "usage: %s [--port 8080] [--fixtures file | --generate count] [--dump file] [--gifts dir] [--latency ms] [--jitter ms] "
+                        "[--loss fraction] [--bandwidth bytes/s] [--seed n] [--quiet]\n",
+            argv[0]);
+        return 1;
+    }
+    rng.seed(options.seed);
+    if (!options.fixtures.empty() && !loadFixtures(options.fixtures))
+    {
+        fprintf(stderr, "couldn't load fixtures from %s\n", options.fixtures.c_str());
+        return 1;
+    }
+    generate(options.generate);
+    if (!options.dump.empty())
+    {
+        return dumpFixtures(options.dump) ? 0 : 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    int one    = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address{};
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port        = htons(options.port);
+    if (server < 0 || bind(server, (sockaddr*)&address, sizeof(address)) != 0 || listen(server, 64) != 0)
+    {
+        perror("couldn't listen");
+        return 1;
+    }
+    fprintf(stderr, "serving %zu Pokémon and %zu bundles on port %d\n", pokemon.size(), bundles.size(), options.port);
+
+    while (true)
+    {
+        int client = accept(server, nullptr, nullptr);
+        if (client >= 0)
+        {
+            std::thread(serve, client).detach();
+        }
+    }
+}
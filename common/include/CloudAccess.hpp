@@ -27,10 +27,14 @@
 #ifndef CLOUDACCESS_HPP
 #define CLOUDACCESS_HPP
 
+#include "GPSSPage.hpp"
 #include "generation.hpp"
-#include "nlohmann/json_fwd.hpp"
-#include <atomic>
+#include "pagedcollection.hpp"
+#include <algorithm>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 class PKX;
 
@@ -42,16 +46,63 @@ public:
         LATEST,
         POPULAR
     };
-    CloudAccess();
+    // Narrows down and reorders what's already been downloaded, without asking the server. Zero species, UNUSED generation and no match
+    // take anything
+    struct Search
+    {
+        enum Order
+        {
+            PAGE_ORDER,
+            SPECIES,
+            LEVEL,
+            GENERATION
+        };
+        u16 species           = 0;
+        Generation generation = Generation::UNUSED;
+        bool shinyOnly        = false;
+        // Goes by what the server says, which isn't part of the PKX
+        bool legalOnly = false;
+        u8 minLevel    = 1;
+        u8 maxLevel    = 100;
+        // Anything else, such as a PKFilter. If what it checks changes, call refreshSearch
+        std::function<bool(const PKX& pkm)> match;
+        Order order = PAGE_ORDER;
+        bool ascend = true;
+    };
+    struct SearchResult
+    {
+        std::shared_ptr<PKX> pkm;
+        bool legal;
+        std::string code;
+    };
+    // cachedPages is how many pages, across all filter settings, are kept in memory; prefetch is how many pages ahead of the current one,
+    // in the direction the user is paging, are downloaded in the background
+    CloudAccess(size_t cachedPages = 12, size_t prefetch = 2);
+    // Shared with the cached page, so it's cheap enough to call every frame. Clone it before changing it
     std::shared_ptr<PKX> pkm(size_t slot) const;
     bool isLegal(size_t slot) const;
-    // Gets the Pokémon and increments the server-side download counter
+    // Gets a copy of the Pokémon and increments the server-side download counter
     std::shared_ptr<PKX> fetchPkm(size_t slot) const;
     long pkm(std::shared_ptr<PKX> pk);
-    int pages() const;
-    int page() const { return pageNumber; }
+    // Matches come straight from the pages cached for the current server-side sort and filters. If there are fewer than wanted and the
+    // cache has room, more pages are downloaded in the background; search again after update() to include them
+    std::vector<SearchResult> search(const Search& query, size_t wanted = 30);
+    // Like fetchPkm, for a search result
+    std::shared_ptr<PKX> fetchPkm(const SearchResult& result) const;
+    // Until clearSearch, the slots and pages show the results of a search, thirty to a page, in place of the server's pages. The results
+    // take in more pages as they arrive
+    void showSearch(const Search& query);
+    void clearSearch();
+    // Runs the shown search again, for when its match would answer differently now. It's otherwise only run again when pages arrive
+    void refreshSearch() { searchDirty = true; }
+    bool searching() const { return searchShown; }
+    const Search& searchQuery() const { return query; }
+    int pages() const { return searchShown ? std::max(((int)results.size() + SLOTS - 1) / SLOTS, 1) : collection.pages(); }
+    int page() const { return searchShown ? searchPage : collection.page(); }
+    // Page flips don't wait for the network. Until the new page arrives, it shows as empty; see loaded()
     bool nextPage();
     bool prevPage();
+    bool loaded() const { return searchShown || collection.loaded(); }
     void sortType(SortType type)
     {
         if (sort != type)
@@ -81,29 +132,55 @@ public:
     bool filterLegal() const { return legal; }
     void filterToGen(Generation g);
     void removeGenFilter();
-    bool good() const { return isGood; }
+    bool good() const { return collection.good(); }
+    // Swaps in pages that finished downloading or were revalidated in the background. Call once per frame
+    void update();
     static std::string makeURL(int page, SortType type, bool ascend, bool legal, Generation low, Generation high, bool LGPE);
-    nlohmann::json grabPage(int page);
 
 private:
-    struct Page
+    // Everything that changes which Pokémon end up on which page
+    struct FilterKey
     {
-        ~Page();
-        std::unique_ptr<nlohmann::json> data;
-        std::atomic<bool> available = false;
+        SortType sort;
+        bool ascend;
+        bool legal;
+        Generation low;
+        Generation high;
+        bool LGPE;
+        bool operator==(const FilterKey& other) const
+        {
+            return sort == other.sort && ascend == other.ascend && legal == other.legal && low == other.low && high == other.high &&
+                   LGPE == other.LGPE;
+        }
     };
-    void refreshPages();
-    static void downloadCloudPage(
-        std::shared_ptr<Page> page, int number, SortType type, bool ascend, bool legal, Generation low, Generation high, bool LGPE);
-    std::shared_ptr<Page> current, next, prev;
-    int pageNumber;
+    static constexpr int SLOTS = 30;
+    FilterKey key() const { return {sort, ascend, legal, lowGen, highGen, showLGPE}; }
+    // Debounced; see PagedCollection::showLater
+    void refreshPages()
+    {
+        collection.showLater(key());
+        searchDirty = true;
+    }
+    // The shown search result for a slot, if there is one
+    const SearchResult* result(size_t slot) const;
+    static PagedCollection<FilterKey, GPSSPage>::Source pageSource();
+    PagedCollection<FilterKey, GPSSPage> collection;
+    // GPSSUpload::batchesDone() as of the last refresh
+    u32 uploadBatches;
     SortType sort      = LATEST;
-    bool isGood        = false;
     bool ascend        = true;
     bool legal         = false;
     Generation lowGen  = Generation::THREE;
     Generation highGen = Generation::SEVEN;
     bool showLGPE      = true;
+    // Set by showSearch
+    Search query;
+    std::vector<SearchResult> results;
+    int searchPage = 1;
+    // The pages the results were last taken from; when they change, the search runs again
+    std::vector<GPSSPage*> searchedPages;
+    bool searchShown     = false;
+    bool searchDirty     = false;
 };
 
 #endif
@@ -36,7 +36,7 @@
 class Configuration
 {
 public:
-    static constexpr int CURRENT_VERSION = 8;
+    static constexpr int CURRENT_VERSION = 9;
 
     static Configuration& getInstance(void)
     {
@@ -107,6 +107,9 @@ public:
 
     bool autoUpdate(void) const;
 
+    // Base URL of the GPSS server, without a trailing slash
+    std::string gpssServer(void) const;
+
     void language(Language lang);
 
     void autoBackup(bool backup);
@@ -154,6 +157,8 @@ public:
 
     void autoUpdate(bool value);
 
+    void gpssServer(const std::string& value);
+
     void save(void);
 
 private:
@@ -0,0 +1,48 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#ifndef DOWNLOADCOUNTER_HPP
+#define DOWNLOADCOUNTER_HPP
+
+#include <string>
+
+// Coalesces GPSS download counter pings. Pings are queued and sent together at background priority once the queue has been quiet for a
+// little while, so that they reuse one connection and stay out of the way of interactive requests. Pings that can't reach the server
+// are tried again with backoff, a limited number of times. exit makes one last attempt, and anything still unsent is saved and sent on
+// the next run
+namespace DownloadCounter
+{
+    void init(void);
+    void exit(void);
+    // Queues a ping for a single Pokémon's GPSS code
+    void pkm(const std::string& code);
+    // Queues a ping for a whole bundle's code
+    void bundle(const std::string& code);
+    // Sends everything queued now instead of waiting
+    void flush(void);
+}
+
+#endif
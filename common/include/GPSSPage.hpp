@@ -0,0 +1,76 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#ifndef GPSSPAGE_HPP
+#define GPSSPAGE_HPP
+
+#include "generation.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+class PKX;
+
+// A page of GPSS results decoded once, when it's downloaded: every Pokémon's data back to back, plus parallel arrays for everything else.
+// Bundle pages additionally split the Pokémon into groups
+struct GPSSPage
+{
+    int pages;
+    // Pokémon for plain pages, bundles for bundle pages
+    int total;
+    std::vector<u8> pkmData;
+    // One more than there are Pokémon, so that Pokémon i is [offsets[i], offsets[i + 1])
+    std::vector<u32> offsets;
+    std::vector<Generation> generations;
+    std::vector<bool> legal;
+    std::vector<std::string> codes;
+    // One more than there are groups, so that group i is Pokémon [groupOffsets[i], groupOffsets[i + 1])
+    std::vector<u32> groupOffsets;
+    std::vector<std::string> groupCodes;
+
+    size_t size() const { return generations.size(); }
+    size_t groups() const { return groupCodes.size(); }
+    size_t groupSize(size_t i) const { return groupOffsets[i + 1] - groupOffsets[i]; }
+    u8* data(size_t i) { return pkmData.data() + offsets[i]; }
+    const u8* data(size_t i) const { return pkmData.data() + offsets[i]; }
+    size_t length(size_t i) const { return offsets[i + 1] - offsets[i]; }
+    // Every Pokémon as a PKX, built the first time they're asked for. Slots holding something that isn't a valid Pokémon are null
+    const std::vector<std::shared_ptr<PKX>>& pokemon();
+
+    // Both validate while they parse, without building a JSON document, and stop at the first thing that doesn't look right
+    static std::unique_ptr<GPSSPage> parse(const std::string& body);
+    static std::unique_ptr<GPSSPage> parseGroups(const std::string& body);
+
+    // Compact binary form for keeping pages on the SD card. deserialize checks every length against the buffer and returns nullptr if
+    // anything is off
+    std::vector<u8> serialize() const;
+    static std::unique_ptr<GPSSPage> deserialize(const u8* data, size_t size);
+
+private:
+    std::vector<std::shared_ptr<PKX>> pkms;
+};
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#ifndef GPSSSTORE_HPP
+#define GPSSSTORE_HPP
+
+#include "GPSSPage.hpp"
+#include <memory>
+#include <string>
+
+// Offline mirror of GPSS pages. Every page that's downloaded is kept decoded on the SD card, keyed by its URL (which spells out the filters
+// and the page number), so that browsing still works without a connection. While the network is reachable, a background job keeps the
+// stored pages from going stale
+namespace GPSSStore
+{
+    constexpr size_t DEFAULT_MAX_SIZE = 4 * 1024 * 1024;
+
+    void init(size_t maxSize = DEFAULT_MAX_SIZE);
+    void exit(void);
+
+    // Keeps a freshly downloaded page. It's written to the SD card in the background, so this is safe from a Fetch callback. Also tells the
+    // store that the network works
+    void store(const std::string& url, const GPSSPage& page);
+    // For when a download couldn't reach the server: returns the stored page, if there is one. Also tells the store that the network is down
+    std::unique_ptr<GPSSPage> load(const std::string& url);
+    bool contains(const std::string& url);
+    // Whether the last request that went through the store reached the server
+    bool online(void);
+}
+
+#endif
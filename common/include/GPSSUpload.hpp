@@ -0,0 +1,56 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#ifndef GPSSUPLOAD_HPP
+#define GPSSUPLOAD_HPP
+
+#include "coretypes.h"
+#include <memory>
+#include <vector>
+
+class PKX;
+
+// Background queue for sharing many Pokémon to GPSS at once, such as a whole box. Uploads run a few at a time, failures that are worth
+// retrying are retried with exponential backoff, and anything that hasn't gone through by exit is saved and picked back up on the next run
+namespace GPSSUpload
+{
+    constexpr size_t DEFAULT_MAX_CONCURRENT = 2;
+
+    void init(void);
+    void exit(void);
+    // Queues the Pokémon and returns right away. Empty slots are skipped
+    void queue(const std::vector<std::shared_ptr<PKX>>& pokemon);
+    // How many uploads are handed to Fetch at once. They go at background priority, so Fetch's cap for that decides how many actually
+    // transfer together; keeping the rest here means download counter pings don't wait behind a whole box
+    void maxConcurrent(size_t max);
+    // Uploads that haven't finished yet, counting ones waiting to be retried
+    size_t pending(void);
+    // Goes up by one every time the queue empties after at least one upload went through. Anything showing GPSS pages can watch this to
+    // refresh once per batch instead of once per Pokémon
+    u32 batchesDone(void);
+}
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#ifndef GIFTDB_HPP
+#define GIFTDB_HPP
+
+#include "coretypes.h"
+#include <atomic>
+#include <stdio.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Mystery gift database converted from the sheetN.json.bz2/dataN.bin.bz2 pair. The file is a header, the fixed-size index sections
+// and a pool of NUL-terminated strings, followed by the raw card data. Only the index and the strings are kept in memory: cards are
+// read from the SD card when they're asked for. Everything is stored in the 3DS' native, little-endian layout.
+// The contents are validated once, when converting, and CRC-32s of them are stored: opening only checks the index against its own,
+// and each card is checked against its own when it's read, so corruption on the SD card is caught without rereading all the data
+namespace GiftDB
+{
+    constexpr u32 MAGIC   = 0x44474B50; // "PKGD"
+    constexpr u32 VERSION = 2;
+
+    enum class CardType : u8
+    {
+        WC4,
+        PGT,
+        PGF,
+        WC6,
+        WC6FULL,
+        WC7,
+        WC7FULL,
+        WB7,
+        WB7FULL
+    };
+
+    // Identifies the files a database was converted from, so that it can be redone when they change
+    struct Source
+    {
+        u32 size;
+        u32 time;
+
+        bool operator==(const Source& other) const { return size == other.size && time == other.time; }
+        bool operator!=(const Source& other) const { return !(*this == other); }
+    };
+
+    struct Header
+    {
+        u32 magic;
+        u32 version;
+        Source sheet;
+        Source data;
+        u32 cardCount;
+        u32 matchCount;
+        u32 matchCardCount;
+        u32 stringsSize;
+        u32 dataSize;
+        // Of the card, match, and match card sections and the strings, in that order
+        u32 indexChecksum;
+    };
+
+    struct Card
+    {
+        // Into the data section
+        u32 offset;
+        u32 size;
+        u32 checksum;
+        // Into the string pool
+        u32 name;
+        u32 game;
+        s16 species;
+        s8 form;
+        s8 gender;
+        CardType type;
+        // "ENG", "JPN", etc. Not NUL-terminated
+        char language[3];
+
+        std::string_view lang() const { return std::string_view(language, sizeof(language)); }
+    };
+
+    // One event in every language it was distributed in: cards [first, first + count) of the match card section
+    struct Match
+    {
+        u32 first;
+        u32 count;
+    };
+
+    static_assert(sizeof(Header) == 48);
+    static_assert(sizeof(Card) == 28);
+    static_assert(sizeof(Match) == 8);
+
+    // Published next to each dataN.bin.bz2, so that an update only has to download the cards that aren't already on the SD card. It's
+    // this header followed by a ManifestCard for every card, in the order their data is laid out in
+    constexpr u32 MANIFEST_MAGIC   = 0x4D474B50; // "PKGM"
+    constexpr u32 MANIFEST_VERSION = 1;
+
+    struct ManifestHeader
+    {
+        u32 magic;
+        u32 version;
+        // SHA-256 of the dataN.bin.bz2 this describes, and of what it decompresses to
+        u8 archiveHash[32];
+        u8 dataHash[32];
+        u32 cardCount;
+    };
+
+    // Cards are downloaded by the hex form of their hash
+    struct ManifestCard
+    {
+        u8 hash[32];
+        u32 size;
+    };
+
+    static_assert(sizeof(ManifestHeader) == 76);
+    static_assert(sizeof(ManifestCard) == 36);
+
+    Source source(const std::string& path);
+
+    // Converts a legacy sheet/data pair into a database at outPath. The data may also be uncompressed, if its name doesn't end in .bz2.
+    // Nothing is left at outPath if it fails or is cancelled. Cancelling takes effect between chunks of decompression, so it can't
+    // interrupt parsing the sheet
+    bool convert(const std::string& sheetPath, const std::string& dataPath, const std::string& outPath,
+        const std::atomic<bool>* cancelled = nullptr);
+
+    class Database
+    {
+    public:
+        Database() = default;
+        ~Database() { close(); }
+        Database(const Database&) = delete;
+        Database& operator=(const Database&) = delete;
+
+        bool open(const std::string& path);
+        void close(void);
+        bool good(void) const { return file != nullptr; }
+        // Whether this was converted from these exact files
+        bool from(const Source& sheet, const Source& data) const { return header.sheet == sheet && header.data == data; }
+
+        size_t cards(void) const { return cardTable.size(); }
+        const Card& card(size_t index) const { return cardTable[index]; }
+        size_t matches(void) const { return matchTable.size(); }
+        const Match& match(size_t index) const { return matchTable[index]; }
+        u32 matchCard(size_t match, size_t i) const { return matchCards[matchTable[match].first + i]; }
+        const char* string(u32 offset) const { return strings.data() + offset; }
+        // What the index and strings take up
+        size_t memory(void) const
+        {
+            return cardTable.capacity() * sizeof(Card) + matchTable.capacity() * sizeof(Match) + matchCards.capacity() * sizeof(u32) +
+                   strings.capacity();
+        }
+
+        // Reads a card's raw data from the SD card. It's empty if the card couldn't be read or doesn't match its checksum
+        std::vector<u8> data(size_t index) const;
+
+    private:
+        Header header{};
+        std::vector<Card> cardTable;
+        std::vector<Match> matchTable;
+        std::vector<u32> matchCards;
+        std::vector<char> strings;
+        FILE* file     = nullptr;
+        long dataStart = 0;
+    };
+}
+
+#endif
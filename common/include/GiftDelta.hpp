@@ -0,0 +1,44 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#ifndef GIFTDELTA_HPP
+#define GIFTDELTA_HPP
+
+#include "coretypes.h"
+#include <string>
+
+// Delta updates of a mystery gift data archive, as published by the EventsGalleryPacker: a manifest listing every card's hash and size
+// in data order, and the cards themselves under cardsURL by the hex form of their hash
+namespace GiftDelta
+{
+    // Writes the decompressed data the manifest describes to outPath, reusing every card the database at databasePath already has and
+    // downloading only the rest. The manifest has to be for the archive with the given hash. Fails without touching outPath if the
+    // manifest doesn't check out, too many cards changed for it to be worth it, or a card is missing or corrupt. Blocks until it's done
+    bool apply(const std::string& manifest, const u8* archiveHash, const std::string& databasePath, const std::string& cardsURL,
+        const std::string& outPath);
+}
+
+#endif
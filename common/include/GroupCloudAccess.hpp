@@ -27,9 +27,9 @@
 #ifndef GROUPCLOUDACCESS_HPP
 #define GROUPCLOUDACCESS_HPP
 
+#include "GPSSPage.hpp"
 #include "generation.hpp"
-#include "nlohmann/json_fwd.hpp"
-#include <atomic>
+#include "pagedcollection.hpp"
 #include <memory>
 
 class PKX;
@@ -46,10 +46,12 @@ public:
     std::shared_ptr<PKX> fetchPkm(size_t groupIndex, size_t pkm) const;
     bool isLegal(size_t groupIndex, size_t pkm) const;
 
-    int pages() const;
-    int page() const { return pageNumber; }
-    bool nextPage();
-    bool prevPage();
+    int pages() const { return collection.pages(); }
+    int page() const { return collection.page(); }
+    // Page flips don't wait for the network. Until the new page arrives, it shows as empty
+    bool nextPage() { return collection.next(); }
+    bool prevPage() { return collection.prev(); }
+    bool loaded() const { return collection.loaded(); }
 
     bool filterLegal() const { return legal; }
     void filterLegal(bool v)
@@ -61,23 +63,29 @@ public:
         }
     }
 
-    bool good() const { return isGood; }
-    nlohmann::json grabPage(int page);
+    bool good() const { return collection.good(); }
+    // Swaps in pages that finished downloading or were revalidated in the background. Call once per frame
+    void update() { collection.update(); }
     static std::string makeURL(int page, bool legal, Generation low, Generation high, bool LGPE);
 
 private:
-    struct Page
+    struct FilterKey
     {
-        ~Page();
-        std::unique_ptr<nlohmann::json> data;
-        std::atomic<bool> available = false;
+        bool legal;
+        Generation low;
+        Generation high;
+        bool LGPE;
+        bool operator==(const FilterKey& other) const
+        {
+            return legal == other.legal && low == other.low && high == other.high && LGPE == other.LGPE;
+        }
     };
-    void refreshPages();
-    static void downloadGroupPage(std::shared_ptr<Page> page, int number, bool legal, Generation low, Generation high, bool LGPE);
-    std::shared_ptr<Page> current, next, prev;
-    int pageNumber;
-    bool isGood = false;
-    bool legal  = false;
+    FilterKey key() const { return {legal, low, high, LGPE}; }
+    // Debounced; see PagedCollection::showLater
+    void refreshPages() { collection.showLater(key()); }
+    static PagedCollection<FilterKey, GPSSPage>::Source pageSource();
+    PagedCollection<FilterKey, GPSSPage> collection;
+    bool legal = false;
     // Currently not changeable
     Generation high = Generation::EIGHT;
     Generation low  = Generation::THREE;
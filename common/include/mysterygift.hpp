@@ -27,17 +27,77 @@
 #ifndef MYSTERYGIFT_HPP
 #define MYSTERYGIFT_HPP
 
-#include "Sav.hpp"
+#include "GiftDB.hpp"
 #include "WCX.hpp"
-#include "nlohmann/json_fwd.hpp"
-#include <bzlib.h>
+#include "generation.hpp"
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Sav;
 
 namespace MysteryGift
 {
+    // What the injector shows about a card. These are built for every card when the database is opened, so that looking one up every
+    // frame is just an array access
+    struct CardInfo
+    {
+        // Shared between all cards that have the same one
+        const std::string* name;
+        const std::string* game;
+        Generation generation;
+        GiftDB::CardType type;
+        int species;
+        int form;
+        int gender;
+        std::string_view lang;
+    };
+
+    // Everything that's set has to match a single card of the event
+    struct Search
+    {
+        // Anywhere in the card's name, ignoring ASCII case
+        std::string text;
+        std::optional<int> species;
+        std::string game;
+        std::optional<GiftDB::CardType> type;
+        std::string lang;
+    };
+
+    // Gifts stay loaded after exit(), and preloaded ones are kept, as long as they take up no more memory than this
+    constexpr size_t MEMORY_BUDGET = 1024 * 1024;
+
+    void initPreloading(void);
+    // Cancels any preload and frees everything that's loaded
+    void exitPreloading(void);
+    // Loads a generation's gifts on a background thread, so that init() for it has nothing left to do. Replaces whatever was loaded or
+    // being loaded for another generation
+    void preload(Generation gen);
+    // Rebuilds a generation's database if the gift files changed since it was last built, so that opening it later is quick. It's safe
+    // to call from any thread, but not while that generation is being loaded
+    bool refresh(Generation gen);
+    // Rebuilds a generation's data from a manifest of its cards, downloading from cardsURL only the ones the local database doesn't
+    // have. The manifest has to be for the archive with the given hash. If this fails, nothing has changed and the full archive should
+    // be downloaded instead. Blocks until it's done, so it's meant for a worker thread
+    bool applyDelta(Generation gen, const std::string& manifest, const u8* archiveHash, const std::string& cardsURL);
+
+    // Waits for a preload of the generation if there's one going
     void init(Generation gen);
-    std::vector<nlohmann::json> wondercards();
-    Sav::giftData wondercardInfo(size_t index);
-    std::unique_ptr<WCX> wondercard(size_t index);
+    // Events, each of which has a card for every language it was distributed in
+    size_t wondercards();
+    bool hasLanguage(size_t event, std::string_view lang);
+    // The event's card in that language, or its first one if it wasn't distributed in it
+    size_t eventCard(size_t event, std::string_view lang);
+    // Matching events, in the same order as they're numbered. An empty search returns all of them
+    std::vector<size_t> search(const Search& search);
+    const CardInfo& wondercardInfo(size_t card);
+    // Null if the card can't be read or fails its checksum
+    std::unique_ptr<WCX> wondercard(size_t card);
+    // Writes the cards into the save's free gift slots, in order, and returns how many were written. Slots that already hold a gift are
+    // left alone. Cards that aren't for the save's generation are skipped, and so is whatever doesn't fit
+    size_t inject(Sav& save, const std::vector<size_t>& cards);
     void exit();
 }
 
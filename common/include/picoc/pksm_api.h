@@ -147,6 +147,10 @@ void sav_get_pkx(struct ParseState*, struct Value*, struct Value**, int);
 void sav_inject_pkx(struct ParseState*, struct Value*, struct Value**, int);
 void sav_inject_wcx(struct ParseState*, struct Value*, struct Value**, int);
 void sav_wcx_free_slot(struct ParseState*, struct Value*, struct Value**, int);
+void sav_inject_gifts(struct ParseState*, struct Value*, struct Value**, int);
+void gift_count(struct ParseState*, struct Value*, struct Value**, int);
+void gift_name(struct ParseState*, struct Value*, struct Value**, int);
+void gift_id(struct ParseState*, struct Value*, struct Value**, int);
 void sav_get_value(struct ParseState*, struct Value*, struct Value**, int);
 void sav_get_max(struct ParseState*, struct Value*, struct Value**, int);
 void sav_get_string(struct ParseState*, struct Value*, struct Value**, int);
@@ -0,0 +1,115 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#ifndef DISKSTORE_HPP
+#define DISKSTORE_HPP
+
+extern "C" {
+#include <sys/lock.h>
+}
+#include "nlohmann/json.hpp"
+#include "types.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// A directory of files keyed by string, usually a URL, with a little JSON metadata for each kept in an index file next to them. Once the
+// files add up to more than the size given to open, the least recently used ones are deleted. Every member is safe to call from any thread.
+// Every file added or removed is appended to a journal right away, so nothing is lost if PKSM is killed before close. The journal is
+// folded into the index when it gets long and on close; only how recently entries were used can be lost
+class DiskStore
+{
+public:
+    // dir must end in a slash. The index is kept in it as index.json, and the journal as journal.json
+    DiskStore(const std::string& dir) : dir(dir), indexPath(dir + "index.json"), journalPath(dir + "journal.json") {}
+
+    // Reads the index, replays the journal over it, and deletes any files neither knows about
+    void open(size_t maxSize);
+    // Writes the index and forgets everything in memory. Anything called after this does nothing
+    void close(void);
+    bool isOpen(void) const { return opened; }
+
+    // Replaces whatever was kept under key. Returns false if the data couldn't be written or is too big to ever fit
+    bool put(const std::string& key, const void* data, size_t size, const nlohmann::json& meta);
+    // Like put, but returns right away and leaves the writing to a worker thread, so that it's safe from a Fetch callback. Until then,
+    // get, meta and contains see the data as if it were written. close writes whatever is still queued
+    bool putLater(const std::string& key, std::string data, const nlohmann::json& meta);
+    // Reads what's kept under key and counts it as used. meta may be null. If the file is gone or short, the entry is dropped
+    bool get(const std::string& key, std::string& data, nlohmann::json* meta = nullptr);
+    // Only the metadata. Doesn't count as a use
+    bool meta(const std::string& key, nlohmann::json& meta);
+    bool contains(const std::string& key);
+    void erase(const std::string& key);
+    // Calls f for every entry, with the store locked, so f mustn't call back into it
+    void forEach(const std::function<void(const std::string& key, const nlohmann::json& meta, u64 lastUsed)>& f);
+
+private:
+    struct Entry
+    {
+        size_t size  = 0;
+        u64 lastUsed = 0;
+        nlohmann::json meta;
+    };
+
+    struct Pending
+    {
+        std::string data;
+        nlohmann::json meta;
+    };
+
+    // Journal lines past which it's folded into the index
+    static constexpr size_t JOURNAL_LIMIT = 64;
+
+    std::string path(const std::string& key) const;
+    // These need the lock held
+    void drop(std::unordered_map<std::string, Entry>::iterator entry);
+    void evict(void);
+    void replay(const nlohmann::json& change);
+    void journal(const nlohmann::json& change);
+    void writeIndex(void);
+    static void writer(void* arg);
+
+    std::string dir;
+    std::string indexPath;
+    std::string journalPath;
+    std::unordered_map<std::string, Entry> entries;
+    // Waiting for the worker. The worker keeps its own reference while it writes one, so that it's only taken out once it's written
+    std::unordered_map<std::string, std::shared_ptr<const Pending>> pending;
+    _LOCK_T mutex;
+    size_t totalSize         = 0;
+    size_t maxSize           = 0;
+    u64 useCounter           = 0;
+    size_t journalLines      = 0;
+    std::atomic<bool> opened = false;
+    // Gives every write its own temporary file, so that two puts of the same key can't write over each other's
+    std::atomic<u32> tmpCounter = 0;
+    std::atomic<bool> writing       = false;
+    std::atomic<bool> writerRunning = false;
+};
+
+#endif
@@ -31,6 +31,7 @@ extern "C" {
 #include <sys/lock.h>
 }
 #include "types.h"
+#include <array>
 #include <atomic>
 #include <curl/curl.h>
 #include <functional>
@@ -43,13 +44,78 @@ extern "C" {
 class Fetch
 {
 public:
+    // Requests of a higher priority (lower value) are never held back by ones of a lower priority. While any INTERACTIVE request is
+    // in flight, lower-priority transfers are paused and queued ones aren't started
+    enum class Priority : u8
+    {
+        // Something the user is actively waiting on
+        INTERACTIVE,
+        // Speculative downloads, like the next page of a list
+        PREFETCH,
+        // Fire-and-forget requests nobody waits on, like download counters
+        BACKGROUND,
+        COUNT
+    };
+
     [[nodiscard]] static std::shared_ptr<Fetch> init(
         const std::string& url, bool ssl, std::string* writeData, struct curl_slist* headers, const std::string& postdata);
+    // Downloads into path + ".part" and moves the file into place once complete. If a previous GET of the same URL was interrupted,
+    // the transfer resumes from the end of the .part file. If sha256Hash is given, the complete file must match it.
+    // Returns 0 on success, -errno on file errors, -CURLMcode or -(CURLcode + 100) on transfer errors, -1 on a bad HTTP response,
+    // and -2 on a checksum mismatch
     static Result download(const std::string& url, const std::string& path, const std::string& postData = "",
-        curl_xferinfo_callback progress = nullptr, void* progressInfo = nullptr);
+        curl_xferinfo_callback progress = nullptr, void* progressInfo = nullptr, const u8* sha256Hash = nullptr);
 
-    static CURLMcode performAsync(std::shared_ptr<Fetch> fetch, std::function<void(CURLcode, std::shared_ptr<Fetch>)> onComplete = nullptr);
+    // Timings of a finished request, all in microseconds from the start of the request
+    struct Metrics
+    {
+        std::string url;
+        CURLcode result;
+        long status;
+        Priority priority;
+        curl_off_t dns;
+        curl_off_t connect;
+        curl_off_t tls;
+        curl_off_t firstByte;
+        curl_off_t total;
+        curl_off_t bytesDown;
+        curl_off_t bytesUp;
+        // Whether an existing connection was used instead of opening a new one
+        bool reused;
+    };
+
+    // Bucket i counts the values that need exactly i bits, so bucket 0 is 0, bucket 1 is 1, bucket 2 is 2-3, bucket 3 is 4-7, and so on
+    struct Histogram
+    {
+        std::array<u32, 40> buckets{};
+        u32 count = 0;
+        // Upper bound of the bucket containing the given fraction of the values
+        curl_off_t percentile(float fraction) const;
+    };
+
+    // onComplete runs on the multi thread with the multi handle and the request list locked. Those locks aren't recursive, so it must
+    // not call performAsync, perform, download or cancel, and anything slow in it holds up every other transfer
+    static CURLMcode performAsync(std::shared_ptr<Fetch> fetch, std::function<void(CURLcode, std::shared_ptr<Fetch>)> onComplete = nullptr,
+        Priority priority = Priority::INTERACTIVE);
     static std::variant<CURLMcode, CURLcode> perform(std::shared_ptr<Fetch> fetch);
+    // Stops a request started with performAsync, whether it's transferring or still queued, and removes it from the multi handle right away.
+    // Its onComplete is called with CURLE_ABORTED_BY_CALLBACK on this thread. Returns false if it had already finished.
+    // Don't call from an onComplete, which runs with the multi handle locked
+    static bool cancel(std::shared_ptr<Fetch> fetch);
+
+    // Splits a raw header line, as given to a CURLOPT_HEADERFUNCTION, into a lowercased name and a trimmed value.
+    // Returns false for lines that aren't name: value pairs, such as the status line
+    static bool parseHeader(const char* data, size_t size, std::string& name, std::string& value);
+
+    // How many requests of a priority may be transferring at once. 0 means unlimited
+    static void maxConcurrent(Priority priority, size_t max);
+
+    // Metrics for the most recently finished requests, oldest first
+    static std::vector<Metrics> recentMetrics(void);
+    // Histogram of one field over the recent requests, e.g. histogram(&Fetch::Metrics::firstByte)
+    static Histogram histogram(curl_off_t Metrics::*field);
+    // Appends the recent requests and a summary to a text file
+    static bool dumpMetrics(const std::string& path);
 
     static Result initMulti();
     static void exitMulti();
@@ -75,6 +141,8 @@ private:
     std::unique_ptr<CURL, decltype(curl_easy_cleanup)*> curl;
 
     static void multiMainThread(void*);
+    static void schedule(void);
+    static void recordMetrics(std::shared_ptr<Fetch> fetch, CURLcode result, Priority priority);
 };
 
 #endif
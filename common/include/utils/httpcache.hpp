@@ -0,0 +1,59 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#ifndef HTTPCACHE_HPP
+#define HTTPCACHE_HPP
+
+#include "fetch.hpp"
+#include <functional>
+#include <memory>
+#include <string>
+
+// Small on-disk cache of GET responses, keyed by URL. Cached responses are revalidated with If-None-Match/If-Modified-Since, and
+// the least recently used entries are evicted once the total body size passes the limit given to init
+namespace HttpCache
+{
+    constexpr size_t DEFAULT_MAX_SIZE = 2 * 1024 * 1024;
+
+    void init(size_t maxSize = DEFAULT_MAX_SIZE);
+    void exit(void);
+
+    // Blocking conditional GET. A 304 fills body from the cache and is reported as a 200. Returns the HTTP status, or 0 if the request failed
+    long get(const std::string& url, std::string& body);
+    // Asynchronous version of get. onComplete is called on the Fetch thread. Returns nullptr if the request couldn't be started
+    std::shared_ptr<Fetch> getAsync(const std::string& url, std::function<void(long status, std::string& body)> onComplete,
+        Fetch::Priority priority = Fetch::Priority::INTERACTIVE);
+    // Stale-while-revalidate. If anything is cached for the URL, it is put in body and true is returned right away; it is then revalidated
+    // in the background at prefetch priority, and onRefresh is called on the Fetch thread if the server had something new.
+    // Otherwise, this is just get
+    bool getStale(const std::string& url, std::string& body, std::function<void(std::string& body)> onRefresh = nullptr);
+    // Like getStale, but returns false without asking the server if nothing is cached, for callers that can't wait on the network
+    bool peekStale(const std::string& url, std::string& body, std::function<void(std::string& body)> onRefresh = nullptr);
+    // Drops the cached response for a URL, if any
+    void invalidate(const std::string& url);
+}
+
+#endif
@@ -0,0 +1,492 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#ifndef PAGEDCOLLECTION_HPP
+#define PAGEDCOLLECTION_HPP
+
+#include "httpcache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A collection on a server that's read a numbered page at a time, such as GPSS. Keeps a window of pages around the shown one, downloaded in
+// the background in the direction the user is paging, plus a least recently used cache of pages across keys so that going back to
+// earlier settings is free. Pages that nothing wants anymore are cancelled rather than left to finish.
+// Key is whatever decides which items end up on which page, and needs operator==. Data needs int members pages, how many pages there
+// are in total, and total, how many items, which is how a page notices the others have shifted
+template <typename Key, typename Data>
+class PagedCollection
+{
+public:
+    struct Source
+    {
+        std::function<std::string(const Key& key, int number)> url;
+        // Turns a response body into a page, or returns nullptr if it isn't one
+        std::function<std::unique_ptr<Data>(const std::string& body)> decode;
+        // Optional. Further checks on a decoded page
+        std::function<bool(const Data& data)> validate;
+        // Optional. Gets every page that comes back, usually on the Fetch thread. fresh is false for pages shown from the HTTP cache while
+        // they're being revalidated
+        std::function<void(const std::string& url, Data& data, bool fresh)> received;
+        // Optional. Asked for a page when the server can't be reached
+        std::function<std::unique_ptr<Data>(const std::string& url)> fallback;
+        // Optional. Whether the server can be reached again, so that pages from fallback are worth downloading again
+        std::function<bool(void)> online;
+    };
+
+    PagedCollection(Source source, size_t cachedPages = 12, size_t prefetch = 2)
+        : source(std::make_shared<const Source>(std::move(source))), maxCachedPages(std::max(cachedPages, prefetch + 2)), prefetchDepth(prefetch)
+    {
+    }
+
+    // Shows a page under a key, waiting on the network if it isn't cached; see good() for whether that worked. Pages that were still
+    // downloading for another key are cancelled. Without wait, a page that isn't cached shows as empty until it arrives, like a page flip,
+    // and update() deals with it having fewer pages or failing
+    bool show(const Key& key, int number, bool wait = true)
+    {
+        if (!(key == shownKey))
+        {
+            cancelIf([&key](const Entry& entry) { return !(entry.key == key) && !entry.page->available; });
+        }
+        shownKey     = key;
+        shownNumber  = std::max(number, 1);
+        Entry* found = entry(shownNumber);
+        if (found && (found->page->available ? (bool)found->page->data : !wait))
+        {
+            // Been here before, or on the way, so there's no need to wait on anything
+            found->lastUsed = ++useCounter;
+            current         = found->page;
+            isGood          = true;
+        }
+        else
+        {
+            current = stalePage(shownNumber, wait);
+            // A page that's still downloading may finish at any moment, so data is only looked at once available says it's there
+            isGood  = !current->available || current->data;
+            if (isGood && current->available && current->data && shownNumber > current->data->pages)
+            {
+                shownNumber = current->data->pages;
+                current     = stalePage(shownNumber, wait);
+                isGood      = !current->available || current->data;
+            }
+            if (isGood)
+            {
+                if ((found = entry(shownNumber)))
+                {
+                    cancel(*found);
+                    found->page     = current;
+                    found->lastUsed = ++useCounter;
+                }
+                else
+                {
+                    cache.push_back({shownKey, shownNumber, current, ++useCounter});
+                    evict();
+                }
+            }
+        }
+
+        if (isGood && current->available && current->data)
+        {
+            pageCount   = current->data->pages;
+            checkedPage = current;
+            prefetch();
+        }
+        return isGood;
+    }
+
+    // Like show, but waits until key has stopped changing for a moment, so that flipping through settings only downloads the combination
+    // that's settled on. Whatever was downloading is cancelled right away, though
+    void showLater(const Key& key)
+    {
+        cancelIf([](const Entry& entry) { return !entry.page->available; });
+        pendingKey  = key;
+        pendingTime = std::chrono::steady_clock::now();
+        keyPending  = true;
+    }
+
+    // Page flips don't wait for the network. Until the new page arrives, it shows as empty; see loaded()
+    bool next()
+    {
+        if (isGood)
+        {
+            direction   = 1;
+            shownNumber = wrap(shownNumber + 1);
+            current     = cloudPage(shownNumber, true);
+            prefetch();
+        }
+        return isGood;
+    }
+
+    bool prev()
+    {
+        if (isGood)
+        {
+            direction   = -1;
+            shownNumber = wrap(shownNumber - 1);
+            current     = cloudPage(shownNumber, true);
+            prefetch();
+        }
+        return isGood;
+    }
+
+    // Throws away every cached page and shows the current one again, for when something changed that moves everything around
+    void reload()
+    {
+        cancelIf([](const Entry&) { return true; });
+        show(shownKey, shownNumber);
+    }
+
+    // Swaps in pages that finished downloading or were revalidated in the background. Call once per frame
+    void update()
+    {
+        if (keyPending && std::chrono::steady_clock::now() - pendingTime >= DEBOUNCE)
+        {
+            keyPending = false;
+            // Mid-frame, so don't wait on the network
+            show(pendingKey, shownNumber, false);
+        }
+        if (current->refreshAvailable)
+        {
+            current->refreshAvailable = false;
+            current->data             = std::move(current->refreshed);
+            checkedPage               = nullptr;
+        }
+        if (current->available && current != checkedPage)
+        {
+            checkedPage = current;
+            if (!current->data)
+            {
+                isGood = false;
+                return;
+            }
+            int newCount = current->data->pages;
+            if (newCount != pageCount)
+            {
+                pageCount = newCount;
+                if (shownNumber > pageCount)
+                {
+                    shownNumber = pageCount;
+                    current     = cloudPage(shownNumber, true);
+                    return;
+                }
+            }
+            checkDesync();
+        }
+    }
+
+    // The shown page, or nullptr if it hasn't arrived yet
+    Data* data() const { return loaded() ? current->data.get() : nullptr; }
+    bool loaded() const { return current && current->available && current->data; }
+    bool good() const { return isGood; }
+    int page() const { return shownNumber; }
+    int pages() const { return pageCount; }
+    // Whether the shown page came from Source::fallback rather than the server
+    bool fromFallback() const { return current && current->fromFallback; }
+
+    // Every page cached for the shown key that's done downloading, in page order
+    std::vector<Data*> cached() const
+    {
+        std::vector<const Entry*> entries;
+        for (auto& cached : cache)
+        {
+            if (cached.key == shownKey && cached.page->available && cached.page->data)
+            {
+                entries.emplace_back(&cached);
+            }
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry* a, const Entry* b) { return a->number < b->number; });
+        std::vector<Data*> ret;
+        for (auto cached : entries)
+        {
+            ret.emplace_back(cached->page->data.get());
+        }
+        return ret;
+    }
+
+    // Downloads pages for the shown key that aren't cached yet in the background, at most prefetch depth at a time and only into free cache
+    // space, so that nothing already cached gets evicted for them
+    void fill()
+    {
+        size_t downloading = std::count_if(
+            cache.begin(), cache.end(), [this](const Entry& entry) { return entry.key == shownKey && !entry.page->available; });
+        size_t room = maxCachedPages > cache.size() ? std::min(maxCachedPages - cache.size(), prefetchDepth) : 0;
+        for (int number = 1; number <= pageCount && downloading < room; number++)
+        {
+            if (!entry(number))
+            {
+                cloudPage(number, false);
+                downloading++;
+            }
+        }
+    }
+
+private:
+    static constexpr std::chrono::milliseconds DEBOUNCE{400};
+
+    struct Page
+    {
+        std::unique_ptr<Data> data;
+        std::atomic<bool> available = false;
+        std::unique_ptr<Data> refreshed;
+        std::atomic<bool> refreshAvailable = false;
+        bool fromFallback                  = false;
+        // Set once nothing wants the page anymore, so that whatever comes back is dropped without being decoded
+        std::atomic<bool> cancelled = false;
+        // Weak so that finished requests don't keep their curl handles around for as long as the page is cached
+        std::weak_ptr<Fetch> fetch;
+    };
+    struct Entry
+    {
+        Key key;
+        int number;
+        std::shared_ptr<Page> page;
+        u64 lastUsed;
+    };
+
+    static std::unique_ptr<Data> decode(const Source& source, const std::string& body)
+    {
+        auto data = source.decode(body);
+        if (data && source.validate && !source.validate(*data))
+        {
+            data = nullptr;
+        }
+        return data;
+    }
+
+    static void fallback(const Source& source, Page& page, const std::string& url)
+    {
+        if (source.fallback)
+        {
+            page.data         = source.fallback(url);
+            page.fromFallback = true;
+        }
+    }
+
+    void download(std::shared_ptr<Page> page, int number, bool interactive)
+    {
+        auto source     = this->source;
+        std::string url = source->url(shownKey, number);
+        auto fetch      = HttpCache::getAsync(url, [page, source, url](long status, std::string& body) {
+            if (page->cancelled)
+            {
+                // Nobody's looking
+            }
+            else if (status == 200)
+            {
+                if ((page->data = decode(*source, body)) && source->received)
+                {
+                    source->received(url, *page->data, true);
+                }
+            }
+            else if (status == 0)
+            {
+                fallback(*source, *page, url);
+            }
+            page->available = true;
+        }, interactive ? Fetch::Priority::INTERACTIVE : Fetch::Priority::PREFETCH);
+        if (fetch)
+        {
+            page->fetch = fetch;
+        }
+        else
+        {
+            fallback(*source, *page, url);
+            page->available = true;
+        }
+    }
+
+    // Anything in the HTTP cache is shown right away and revalidated in the background. Otherwise, this either waits on the network or
+    // returns a page that's still downloading
+    std::shared_ptr<Page> stalePage(int number, bool wait)
+    {
+        auto page       = std::make_shared<Page>();
+        auto source     = this->source;
+        std::string url = source->url(shownKey, number);
+        std::string body;
+        auto onRefresh  = [page, source, url](std::string& body) {
+            if (!page->cancelled && (page->refreshed = decode(*source, body)))
+            {
+                if (source->received)
+                {
+                    source->received(url, *page->refreshed, true);
+                }
+                page->refreshAvailable = true;
+            }
+        };
+        if (!wait && !HttpCache::peekStale(url, body, onRefresh))
+        {
+            download(page, number, true);
+            return page;
+        }
+        if (!wait || HttpCache::getStale(url, body, onRefresh))
+        {
+            if ((page->data = decode(*source, body)) && source->received)
+            {
+                source->received(url, *page->data, false);
+            }
+        }
+        else
+        {
+            fallback(*source, *page, url);
+        }
+        page->available = true;
+        return page;
+    }
+
+    Entry* entry(int number)
+    {
+        for (auto& cached : cache)
+        {
+            if (cached.key == shownKey && cached.number == number)
+            {
+                return &cached;
+            }
+        }
+        return nullptr;
+    }
+
+    // Finds a page in the cache, starting a download if it isn't there
+    std::shared_ptr<Page> cloudPage(int number, bool interactive)
+    {
+        if (Entry* cached = entry(number))
+        {
+            // Failed downloads are worth another shot, as are pages from the fallback once the server can be reached again
+            if (cached->page->available &&
+                (!cached->page->data || (cached->page->fromFallback && source->online && source->online())))
+            {
+                cached->page = std::make_shared<Page>();
+                download(cached->page, number, interactive);
+            }
+            cached->lastUsed = ++useCounter;
+            return cached->page;
+        }
+
+        auto page = std::make_shared<Page>();
+        download(page, number, interactive);
+        cache.push_back({shownKey, number, page, ++useCounter});
+        evict();
+        return page;
+    }
+
+    int wrap(int number) const { return ((number - 1) % pageCount + pageCount) % pageCount + 1; }
+
+    void prefetch()
+    {
+        if (pageCount <= 1)
+        {
+            return;
+        }
+        for (size_t i = 1; i <= prefetchDepth && (int)i < pageCount; i++)
+        {
+            cloudPage(wrap(shownNumber + direction * (int)i), false);
+        }
+        // And one behind, so that turning around is just as quick
+        cloudPage(wrap(shownNumber - direction), false);
+    }
+
+    static void cancel(Entry& entry)
+    {
+        if (!entry.page->available)
+        {
+            entry.page->cancelled = true;
+            // Frees the connection for the pages that are wanted; the callback sees cancelled and just marks the page done
+            if (auto fetch = entry.page->fetch.lock())
+            {
+                Fetch::cancel(fetch);
+            }
+        }
+    }
+
+    template <typename Pred>
+    void cancelIf(Pred pred)
+    {
+        cache.erase(std::remove_if(cache.begin(), cache.end(),
+                        [&pred, this](Entry& entry) {
+                            if (entry.page != current && pred(entry))
+                            {
+                                cancel(entry);
+                                return true;
+                            }
+                            return false;
+                        }),
+            cache.end());
+    }
+
+    void evict()
+    {
+        while (cache.size() > maxCachedPages)
+        {
+            auto oldest = cache.end();
+            for (auto it = cache.begin(); it != cache.end(); ++it)
+            {
+                if (it->page != current && (oldest == cache.end() || it->lastUsed < oldest->lastUsed))
+                {
+                    oldest = it;
+                }
+            }
+            if (oldest == cache.end())
+            {
+                break;
+            }
+            cancel(*oldest);
+            cache.erase(oldest);
+        }
+    }
+
+    // If the number of items changed since the other pages were downloaded, their contents have shifted, so get them again
+    void checkDesync()
+    {
+        int total = current->data->total;
+        cancelIf([total, this](const Entry& entry) {
+            return entry.key == shownKey && entry.page->available && entry.page->data && entry.page->data->total != total;
+        });
+        prefetch();
+    }
+
+    std::shared_ptr<const Source> source;
+    std::vector<Entry> cache;
+    std::shared_ptr<Page> current;
+    // The last page update() looked at, so that it only checks each once
+    std::shared_ptr<Page> checkedPage;
+    size_t maxCachedPages;
+    size_t prefetchDepth;
+    u64 useCounter  = 0;
+    Key shownKey    = {};
+    int shownNumber = 1;
+    int pageCount   = 1;
+    int direction   = 1;
+    bool isGood     = false;
+    // Set by showLater
+    Key pendingKey  = {};
+    bool keyPending = false;
+    std::chrono::steady_clock::time_point pendingTime;
+};
+
+#endif
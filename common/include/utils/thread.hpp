@@ -33,7 +33,8 @@ namespace Threads
 {
     void init(void);
     // stackSize will be ignored on systems that don't provide explicit setting of it. KEEP THIS IN MIND IF YOU ARE PORTING
-    bool create(void (*entrypoint)(void*), void* arg = nullptr, std::optional<size_t> stackSize = std::nullopt);
+    // Background threads only run while the main thread is waiting, so that long jobs on them can't hold up the UI
+    bool create(void (*entrypoint)(void*), void* arg = nullptr, std::optional<size_t> stackSize = std::nullopt, bool background = false);
     void exit(void);
 }
 
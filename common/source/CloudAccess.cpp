@@ -26,14 +26,15 @@
 
 #include "CloudAccess.hpp"
 #include "Configuration.hpp"
+#include "DownloadCounter.hpp"
+#include "GPSSStore.hpp"
+#include "GPSSUpload.hpp"
 #include "PK7.hpp"
 #include "PKX.hpp"
 #include "app.hpp"
-#include "base64.hpp"
 #include "fetch.hpp"
-#include "nlohmann/json.hpp"
 #include "thread.hpp"
-#include <unistd.h>
+#include <algorithm>
 
 namespace
 {
@@ -50,132 +51,112 @@ namespace
     }
 }
 
-CloudAccess::Page::~Page() {}
-
-void CloudAccess::downloadCloudPage(
-    std::shared_ptr<Page> page, int number, SortType type, bool ascend, bool legal, Generation low, Generation high, bool LGPE)
+PagedCollection<CloudAccess::FilterKey, GPSSPage>::Source CloudAccess::pageSource()
 {
-    std::string* retData = new std::string;
-    auto fetch           = Fetch::init(CloudAccess::makeURL(number, type, ascend, legal, low, high, LGPE), true, retData, nullptr, "");
-    Fetch::performAsync(fetch, [page, retData](CURLcode code, std::shared_ptr<Fetch> fetch) {
-        if (code == CURLE_OK)
+    PagedCollection<FilterKey, GPSSPage>::Source source;
+    source.url      = [](const FilterKey& key, int number) {
+        return makeURL(number, key.sort, key.ascend, key.legal, key.low, key.high, key.LGPE);
+    };
+    source.decode   = GPSSPage::parse;
+    source.received = [](const std::string& url, GPSSPage& data, bool fresh) {
+        if (fresh || !GPSSStore::contains(url))
         {
-            long status_code;
-            fetch->getinfo(CURLINFO_RESPONSE_CODE, &status_code);
-            switch (status_code)
-            {
-                case 200:
-                    page->data = std::make_unique<nlohmann::json>(nlohmann::json::parse(*retData, nullptr, false));
-                    // clang-format off
-                    if (!page->data || !page->data->is_object() ||
-                        !page->data->contains("total_pkm") || !(*page->data)["total_pkm"].is_number_integer() ||
-                        !page->data->contains("results") || !(*page->data)["results"].is_array() ||
-                        !page->data->contains("pages") || !(*page->data)["pages"].is_number_integer())
-                    // clang-format on
-                    {
-                        page->data = nullptr;
-                    }
-                    else
-                    {
-                        for (auto& json : (*page->data)["results"])
-                        {
-                            // clang-format off
-                            if (!json.is_object() ||
-                                !json.contains("base_64") || !json["base_64"].is_string() ||
-                                !json.contains("generation") || !json["generation"].is_string() ||
-                                !json.contains("legal") || !json["legal"].is_boolean() ||
-                                !json.contains("code") || !json["code"].is_string())
-                            // clang-format on
-                            {
-                                page->data = nullptr;
-                                break;
-                            }
-                        }
-                    }
-                    break;
-                default:
-                    break;
-            }
+            GPSSStore::store(url, data);
         }
-        delete retData;
-        page->available = true;
-    });
+        // Build the Pokémon now, off the UI thread, so that drawing the page doesn't decode anything
+        data.pokemon();
+    };
+    source.fallback = [](const std::string& url) {
+        auto data = GPSSStore::load(url);
+        if (data)
+        {
+            data->pokemon();
+        }
+        return data;
+    };
+    source.online   = GPSSStore::online;
+    return source;
 }
 
-CloudAccess::CloudAccess() : pageNumber(1)
+CloudAccess::CloudAccess(size_t cachedPages, size_t prefetch)
+    : collection(pageSource(), cachedPages, prefetch), uploadBatches(GPSSUpload::batchesDone())
 {
-    refreshPages();
+    collection.show(key(), 1);
 }
 
-void CloudAccess::refreshPages()
+void CloudAccess::update()
 {
-    current            = std::make_shared<Page>();
-    current->data      = std::make_unique<nlohmann::json>(grabPage(pageNumber));
-    current->available = true;
-    isGood             = (bool)current->data && !current->data->is_discarded();
-    if (isGood && pageNumber >= pages())
+    if (GPSSUpload::batchesDone() != uploadBatches)
     {
-        pageNumber         = pages();
-        current->data      = std::make_unique<nlohmann::json>(grabPage(pages()));
-        current->available = true;
-        isGood             = (bool)current->data && !current->data->is_discarded();
+        // A bulk upload went through, so every page may have shifted. Only one refresh for the whole batch, though
+        uploadBatches = GPSSUpload::batchesDone();
+        collection.reload();
+        searchDirty = true;
     }
-    if (isGood)
+    collection.update();
+
+    if (searchShown)
     {
-        if (pages() > 1)
-        {
-            int page = (pageNumber % pages()) + 1;
-            next     = std::make_shared<Page>();
-            downloadCloudPage(next, page, sort, ascend, legal, lowGen, highGen, showLGPE);
-            if (pages() > 2)
-            {
-                page = pageNumber - 1 == 0 ? pages() : pageNumber - 1;
-                prev = std::make_shared<Page>();
-                downloadCloudPage(prev, page, sort, ascend, legal, lowGen, highGen, showLGPE);
-            }
-            else
-            {
-                prev = next;
-            }
-        }
-        else
+        // Pages that were revalidated with new contents are new objects, so this catches those as well as pages coming and going
+        std::vector<GPSSPage*> pages = collection.cached();
+        if (searchDirty || pages != searchedPages)
         {
-            next = prev = current;
+            searchDirty   = false;
+            searchedPages = std::move(pages);
+            // Enough for the shown page and the next, so that flipping forward finds something
+            results    = search(query, (searchPage + 1) * SLOTS);
+            searchPage = std::min(searchPage, this->pages());
         }
     }
 }
 
-nlohmann::json CloudAccess::grabPage(int num)
+void CloudAccess::showSearch(const Search& query)
 {
-    std::string retData;
-    auto fetch = Fetch::init(makeURL(num, sort, ascend, legal, lowGen, highGen, showLGPE), true, &retData, nullptr, "");
-    auto res   = Fetch::perform(fetch);
-    if (res.index() == 0)
-    {
-        return {};
-    }
-    else if (std::get<1>(res) == CURLE_OK)
+    this->query = query;
+    searchShown = true;
+    searchDirty = true;
+    searchPage  = 1;
+    update();
+}
+
+void CloudAccess::clearSearch()
+{
+    searchShown = false;
+    results.clear();
+    searchedPages.clear();
+}
+
+bool CloudAccess::nextPage()
+{
+    if (searchShown)
     {
-        long status_code;
-        fetch->getinfo(CURLINFO_RESPONSE_CODE, &status_code);
-        switch (status_code)
-        {
-            case 200:
-                break;
-            default:
-                return {};
-        }
-        return nlohmann::json::parse(retData, nullptr, false);
+        searchPage = searchPage % pages() + 1;
+        // The pages after the last result may be worth downloading
+        searchDirty = true;
+        return true;
     }
-    else
+    return collection.next();
+}
+
+bool CloudAccess::prevPage()
+{
+    if (searchShown)
     {
-        return {};
+        searchPage = (searchPage + pages() - 2) % pages() + 1;
+        return true;
     }
+    return collection.prev();
+}
+
+const CloudAccess::SearchResult* CloudAccess::result(size_t slot) const
+{
+    size_t index = (searchPage - 1) * SLOTS + slot;
+    return slot < SLOTS && index < results.size() ? &results[index] : nullptr;
 }
 
 std::string CloudAccess::makeURL(int num, SortType type, bool ascend, bool legal, Generation low, Generation high, bool LGPE)
 {
-    return "https://flagbrew.org/api/v1/gpss/all?pksm=yes&count=30&sort=" + sortTypeToString(type) +
+    return Configuration::getInstance().gpssServer() + "/api/v1/gpss/all?pksm=yes&count=30&sort=" + sortTypeToString(type) +
            "&dir=" + (ascend ? std::string("ascend") : std::string("descend")) +
            "&legal_only=" + (legal ? std::string("True") : std::string("False")) + "&page=" + std::to_string(num) + "&min_gen=" + genToString(low) +
            "&max_gen=" + genToString(high) + "&lgpe=" + (LGPE ? std::string("yes") : std::string("no"));
@@ -183,15 +164,15 @@ std::string CloudAccess::makeURL(int num, SortType type, bool ascend, bool legal
 
 std::shared_ptr<PKX> CloudAccess::pkm(size_t slot) const
 {
-    if (slot < (*current->data)["results"].size())
+    if (searchShown)
     {
-        std::string b64Data = (*current->data)["results"][slot]["base_64"].get<std::string>();
-        Generation gen      = stringToGen((*current->data)["results"][slot]["generation"].get<std::string>());
-        // Legal info: needs thought
-        auto retData = base64_decode(b64Data.data(), b64Data.size());
-
-        auto ret = PKX::getPKM(gen, retData.data(), retData.size());
-        if (ret)
+        auto found = result(slot);
+        return found ? found->pkm : PKX::getPKM<Generation::SEVEN>(nullptr);
+    }
+    GPSSPage* data = collection.data();
+    if (data && slot < data->size())
+    {
+        if (auto ret = data->pokemon()[slot])
         {
             return ret;
         }
@@ -201,88 +182,97 @@ std::shared_ptr<PKX> CloudAccess::pkm(size_t slot) const
 
 bool CloudAccess::isLegal(size_t slot) const
 {
-    if (slot < (*current->data)["results"].size())
+    if (searchShown)
+    {
+        auto found = result(slot);
+        return found && found->legal;
+    }
+    GPSSPage* data = collection.data();
+    if (data && slot < data->size())
     {
-        return (*current->data)["results"][slot]["legal"].get<bool>();
+        return data->legal[slot];
     }
     return false;
 }
 
-std::shared_ptr<PKX> CloudAccess::fetchPkm(size_t slot) const
+std::vector<CloudAccess::SearchResult> CloudAccess::search(const Search& query, size_t wanted)
 {
-    if (slot < (*current->data)["results"].size())
+    std::vector<SearchResult> ret;
+    for (auto data : collection.cached())
     {
-        auto ret = pkm(slot);
-
-        if (auto fetch = Fetch::init(
-                "https://flagbrew.org/gpss/download/" + (*current->data)["results"][slot]["code"].get<std::string>(), true, nullptr, nullptr, ""))
+        auto& pkms = data->pokemon();
+        for (size_t i = 0; i < data->size(); i++)
         {
-            Fetch::performAsync(fetch);
+            auto& pkm = pkms[i];
+            // clang-format off
+            if (!pkm || pkm->species() == 0 ||
+                (query.species != 0 && pkm->species() != query.species) ||
+                (query.generation != Generation::UNUSED && pkm->generation() != query.generation) ||
+                (query.shinyOnly && !pkm->shiny()) ||
+                (query.legalOnly && !data->legal[i]) ||
+                pkm->level() < query.minLevel || pkm->level() > query.maxLevel ||
+                (query.match && !query.match(*pkm)))
+            // clang-format on
+            {
+                continue;
+            }
+            ret.push_back({pkm, data->legal[i], data->codes[i]});
         }
-
-        return ret;
     }
-    return PKX::getPKM<Generation::SEVEN>(nullptr);
-}
 
-bool CloudAccess::nextPage()
-{
-    while (!next->available)
+    if (query.order != Search::PAGE_ORDER)
     {
-        usleep(100);
-    }
-    if (!next->data || next->data->is_discarded())
-    {
-        return isGood = false;
+        // Stable, so that ties stay in the order the server sorted them
+        std::stable_sort(ret.begin(), ret.end(), [&query](const SearchResult& a, const SearchResult& b) {
+            const SearchResult& first  = query.ascend ? a : b;
+            const SearchResult& second = query.ascend ? b : a;
+            switch (query.order)
+            {
+                case Search::SPECIES:
+                    return first.pkm->species() < second.pkm->species();
+                case Search::LEVEL:
+                    return first.pkm->level() < second.pkm->level();
+                case Search::GENERATION:
+                    return first.pkm->generation() < second.pkm->generation();
+                default:
+                    return false;
+            }
+        });
     }
-    // Update data
-    pageNumber = (pageNumber % pages()) + 1;
-    prev       = current;
-    current    = next;
-    next       = std::make_shared<Page>();
 
-    // Download next page in the background
-    int nextPage = (pageNumber % pages()) + 1;
-    downloadCloudPage(next, nextPage, sort, ascend, legal, lowGen, highGen, showLGPE);
-
-    // If there's a mon number desync, also download the previous page again
-    if ((*current->data)["total_pkm"] != (*prev->data)["total_pkm"])
+    if (ret.size() < wanted)
     {
-        int prevPage = pageNumber - 1 == 0 ? pages() : pageNumber - 1;
-        downloadCloudPage(prev, prevPage, sort, ascend, legal, lowGen, highGen, showLGPE);
+        collection.fill();
     }
 
-    return isGood;
+    return ret;
 }
 
-bool CloudAccess::prevPage()
+std::shared_ptr<PKX> CloudAccess::fetchPkm(const SearchResult& result) const
 {
-    while (!prev->available)
+    DownloadCounter::pkm(result.code);
+    // The result's Pokémon is shared with the page it came from, so hand out a copy that's safe to change
+    return result.pkm->clone();
+}
+
+std::shared_ptr<PKX> CloudAccess::fetchPkm(size_t slot) const
+{
+    if (searchShown)
     {
-        usleep(100);
+        auto found = result(slot);
+        return found ? fetchPkm(*found) : PKX::getPKM<Generation::SEVEN>(nullptr);
     }
-    if (!prev->data || prev->data->is_discarded())
+    GPSSPage* data = collection.data();
+    if (data && slot < data->size())
     {
-        return isGood = false;
-    }
-    // Update data
-    pageNumber = pageNumber - 1 == 0 ? pages() : pageNumber - 1;
-    next       = current;
-    current    = prev;
-    prev       = std::make_shared<Page>();
+        // The cached one is shared with everything drawing this page, so hand out a copy that's safe to change
+        auto ret = pkm(slot)->clone();
 
-    // Download the next page in the background
-    int prevPage = pageNumber - 1 == 0 ? pages() : pageNumber - 1;
-    downloadCloudPage(prev, prevPage, sort, ascend, legal, lowGen, highGen, showLGPE);
+        DownloadCounter::pkm(data->codes[slot]);
 
-    // If there's a mon number desync, also download the next page again
-    if ((*current->data)["total_pkm"] != (*next->data)["total_pkm"])
-    {
-        int nextPage = (pageNumber % pages()) + 1;
-        downloadCloudPage(next, nextPage, sort, ascend, legal, lowGen, highGen, showLGPE);
+        return ret;
     }
-
-    return isGood;
+    return PKX::getPKM<Generation::SEVEN>(nullptr);
 }
 
 long CloudAccess::pkm(std::shared_ptr<PKX> mon)
@@ -303,7 +293,7 @@ long CloudAccess::pkm(std::shared_ptr<PKX> mon)
     }
 
     std::string writeData = "";
-    if (auto fetch = Fetch::init("https://flagbrew.org/gpss/share", true, &writeData, headers, ""))
+    if (auto fetch = Fetch::init(Configuration::getInstance().gpssServer() + "/gpss/share", true, &writeData, headers, ""))
     {
         auto mimeThing       = fetch->mimeInit();
         curl_mimepart* field = curl_mime_addpart(mimeThing.get());
@@ -318,7 +308,8 @@ long CloudAccess::pkm(std::shared_ptr<PKX> mon)
             fetch->getinfo(CURLINFO_RESPONSE_CODE, &ret);
             if (ret == 201)
             {
-                refreshPages();
+                // Every page may have shifted
+                collection.reload();
             }
         }
     }
@@ -326,11 +317,6 @@ long CloudAccess::pkm(std::shared_ptr<PKX> mon)
     return ret;
 }
 
-int CloudAccess::pages() const
-{
-    return (*current->data)["pages"].get<int>();
-}
-
 void CloudAccess::filterToGen(Generation g)
 {
     if (g != Generation::LGPE)
@@ -344,6 +330,7 @@ void CloudAccess::filterToGen(Generation g)
         highGen  = Generation::FOUR;
         showLGPE = true;
     }
+    refreshPages();
 }
 
 void CloudAccess::removeGenFilter()
@@ -351,4 +338,5 @@ void CloudAccess::removeGenFilter()
     lowGen   = Generation::THREE;
     highGen  = Generation::SEVEN;
     showLGPE = true;
+    refreshPages();
 }
@@ -0,0 +1,232 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#include "DownloadCounter.hpp"
+#include "Configuration.hpp"
+#include "fetch.hpp"
+#include "nlohmann/json.hpp"
+#include "thread.hpp"
+#include <algorithm>
+#include <atomic>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    constexpr const char* PENDING_PATH = "/3ds/PKSM/cache/downloadcounters.json";
+    // Seconds the queue must be quiet before it's sent
+    constexpr time_t FLUSH_DELAY = 5;
+    // Send right away once this many are waiting
+    constexpr size_t FLUSH_COUNT = 12;
+    // After a failed send, the queue waits this long, doubling with every failed attempt up to MAX_BACKOFF
+    constexpr time_t BASE_BACKOFF = 2;
+    constexpr time_t MAX_BACKOFF  = 5 * 60;
+    // After this many failed attempts, a ping is given up on
+    constexpr int MAX_ATTEMPTS = 8;
+    // How long exit waits on its last flush before saving what's left
+    constexpr int EXIT_WAIT_MS = 2000;
+
+    struct Ping
+    {
+        std::string url;
+        int attempts = 0;
+    };
+
+    std::vector<Ping> pending;
+    std::vector<Ping> inFlight;
+    _LOCK_T pendingMutex;
+    time_t lastAdded           = 0;
+    time_t retryAt             = 0;
+    std::atomic<bool> doFlush  = false;
+    std::atomic_flag keepGoing = ATOMIC_FLAG_INIT;
+    std::atomic<bool> running  = false;
+
+    void add(const std::string& url)
+    {
+        __lock_acquire(pendingMutex);
+        pending.push_back({url});
+        lastAdded = time(nullptr);
+        if (pending.size() >= FLUSH_COUNT)
+        {
+            doFlush = true;
+        }
+        __lock_release(pendingMutex);
+    }
+
+    void send(void)
+    {
+        __lock_acquire(pendingMutex);
+        std::vector<Ping> sendMe = std::move(pending);
+        pending.clear();
+        inFlight.insert(inFlight.end(), sendMe.begin(), sendMe.end());
+        __lock_release(pendingMutex);
+
+        for (auto& ping : sendMe)
+        {
+            auto done = [ping](CURLcode code, std::shared_ptr<Fetch>) {
+                __lock_acquire(pendingMutex);
+                auto found = std::find_if(inFlight.begin(), inFlight.end(), [&ping](const Ping& other) { return other.url == ping.url; });
+                if (found != inFlight.end())
+                {
+                    inFlight.erase(found);
+                }
+                // Only connection problems are worth trying again; the server has already answered anything else. While the connection is
+                // down every ping fails the same way, so the whole queue backs off
+                if (code != CURLE_OK && ping.attempts + 1 < MAX_ATTEMPTS)
+                {
+                    pending.push_back({ping.url, ping.attempts + 1});
+                    lastAdded = time(nullptr);
+                    retryAt   = std::max(retryAt, lastAdded + std::min(BASE_BACKOFF << ping.attempts, MAX_BACKOFF));
+                }
+                __lock_release(pendingMutex);
+            };
+            auto fetch = Fetch::init(ping.url, true, nullptr, nullptr, "");
+            if (!fetch || Fetch::performAsync(fetch, done, Fetch::Priority::BACKGROUND) != CURLM_OK)
+            {
+                done(CURLE_FAILED_INIT, nullptr);
+            }
+        }
+    }
+
+    void flushThread(void*)
+    {
+        while (keepGoing.test_and_set())
+        {
+            __lock_acquire(pendingMutex);
+            time_t now = time(nullptr);
+            bool ready = !pending.empty() && now >= retryAt && (doFlush || now - lastAdded >= FLUSH_DELAY);
+            __lock_release(pendingMutex);
+            if (ready)
+            {
+                doFlush = false;
+                send();
+            }
+            usleep(100'000);
+        }
+        running = false;
+    }
+}
+
+void DownloadCounter::init(void)
+{
+    __lock_init(pendingMutex);
+
+    FILE* in = fopen(PENDING_PATH, "rb");
+    if (in)
+    {
+        fseek(in, 0, SEEK_END);
+        size_t size = ftell(in);
+        rewind(in);
+        std::string data(size, '\0');
+        fread(data.data(), 1, size, in);
+        fclose(in);
+        remove(PENDING_PATH);
+
+        nlohmann::json saved = nlohmann::json::parse(data, nullptr, false);
+        if (saved.is_array())
+        {
+            for (auto& ping : saved)
+            {
+                // Older versions saved just the URLs
+                if (ping.is_string())
+                {
+                    pending.push_back({ping.get<std::string>()});
+                }
+                else if (ping.is_object() && ping.contains("url") && ping["url"].is_string())
+                {
+                    pending.push_back({ping["url"].get<std::string>(), ping.value("attempts", 0)});
+                }
+            }
+        }
+    }
+
+    keepGoing.test_and_set();
+    running = Threads::create(flushThread, nullptr, 8 * 1024);
+}
+
+void DownloadCounter::exit(void)
+{
+    keepGoing.clear();
+    while (running)
+    {
+        usleep(100);
+    }
+
+    // One last try, backoff or not, so that pings don't wait for the next run when the connection is fine
+    send();
+    for (int waited = 0; waited < EXIT_WAIT_MS; waited += 10)
+    {
+        __lock_acquire(pendingMutex);
+        bool sent = inFlight.empty();
+        __lock_release(pendingMutex);
+        if (sent)
+        {
+            break;
+        }
+        usleep(10'000);
+    }
+
+    // Whatever's still in flight gets cut off when Fetch exits, so save it along with the rest
+    __lock_acquire(pendingMutex);
+    nlohmann::json save = nlohmann::json::array();
+    for (auto* pings : {&pending, &inFlight})
+    {
+        for (auto& ping : *pings)
+        {
+            save.push_back({{"url", ping.url}, {"attempts", ping.attempts}});
+        }
+    }
+    pending.clear();
+    inFlight.clear();
+    __lock_release(pendingMutex);
+
+    if (!save.empty())
+    {
+        std::string data = save.dump();
+        FILE* out        = fopen(PENDING_PATH, "wb");
+        if (out)
+        {
+            fwrite(data.data(), 1, data.size(), out);
+            fclose(out);
+        }
+    }
+}
+
+void DownloadCounter::pkm(const std::string& code)
+{
+    add(Configuration::getInstance().gpssServer() + "/gpss/download/" + code);
+}
+
+void DownloadCounter::bundle(const std::string& code)
+{
+    add(Configuration::getInstance().gpssServer() + "/gpss/download/bundle/" + code);
+}
+
+void DownloadCounter::flush(void)
+{
+    doFlush = true;
+}
@@ -0,0 +1,505 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#include "GPSSPage.hpp"
+#include "PKX.hpp"
+#include "base64.hpp"
+#include "nlohmann/json.hpp"
+#include <algorithm>
+#include <climits>
+
+namespace
+{
+    // Walks a GPSS response as nlohmann's SAX parser reads it, copying out only the fields a page needs. Anything that isn't the right
+    // type, or a Pokémon or group missing one of its fields, makes it return false, which stops the parse right there
+    class PageHandler
+    {
+    public:
+        PageHandler(GPSSPage& page, bool groups) : page(page), groups(groups)
+        {
+            page.offsets.push_back(0);
+            if (groups)
+            {
+                page.groupOffsets.push_back(0);
+            }
+        }
+
+        bool null() { return value(0); }
+        bool boolean(bool v)
+        {
+            if (!value(LEGAL))
+            {
+                return false;
+            }
+            if (field == LEGAL)
+            {
+                monLegal = v;
+            }
+            return true;
+        }
+        bool number_integer(nlohmann::json::number_integer_t v) { return integer(v); }
+        bool number_unsigned(nlohmann::json::number_unsigned_t v) { return integer((s64)std::min(v, (nlohmann::json::number_unsigned_t)INT_MAX)); }
+        bool number_float(nlohmann::json::number_float_t, const std::string&) { return value(0); }
+        bool string(std::string& v)
+        {
+            if (!value(CODE | DATA | GENERATION))
+            {
+                return false;
+            }
+            switch (field)
+            {
+                case DATA:
+                    monData = std::move(v);
+                    break;
+                case GENERATION:
+                    monGen = stringToGen(v);
+                    break;
+                case CODE:
+                    // A group's code can come before its Pokémon, so it can't share theirs
+                    (stack.back().context == GROUP ? groupCode : code) = std::move(v);
+                    break;
+                default:
+                    break;
+            }
+            return true;
+        }
+        template <typename Binary>
+        bool binary(Binary&)
+        {
+            return value(0);
+        }
+
+        bool key(std::string& k)
+        {
+            if (skip == 0)
+            {
+                field = fieldFor(k);
+            }
+            return true;
+        }
+
+        bool start_object(size_t)
+        {
+            if (skip > 0 || (!stack.empty() && !isList() && field == 0))
+            {
+                skip++;
+                return true;
+            }
+            if (stack.empty())
+            {
+                stack.push_back({ROOT, 0});
+                return true;
+            }
+            if (isList())
+            {
+                stack.push_back({stack.back().context == RESULTS && groups ? GROUP : MON, 0});
+                return true;
+            }
+            return false;
+        }
+        bool end_object()
+        {
+            if (skip > 0)
+            {
+                skip--;
+                return true;
+            }
+            // The parser itself makes sure that this matches a start_object
+            Level level = stack.back();
+            stack.pop_back();
+            switch (level.context)
+            {
+                case ROOT:
+                    return level.seen == (TOTAL | PAGES | LIST);
+                case GROUP:
+                    if (level.seen != (LIST | CODE))
+                    {
+                        return false;
+                    }
+                    page.groupCodes.emplace_back(std::move(groupCode));
+                    page.groupOffsets.push_back(page.size());
+                    return true;
+                case MON:
+                    if (level.seen != (CODE | DATA | GENERATION | LEGAL))
+                    {
+                        return false;
+                    }
+                    {
+                        auto data = base64_decode(monData);
+                        page.pkmData.insert(page.pkmData.end(), data.begin(), data.end());
+                    }
+                    page.offsets.push_back(page.pkmData.size());
+                    page.generations.push_back(monGen);
+                    page.legal.push_back(monLegal);
+                    page.codes.emplace_back(std::move(code));
+                    return true;
+                default:
+                    return false;
+            }
+        }
+        bool start_array(size_t)
+        {
+            if (skip > 0 || (!stack.empty() && !isList() && field == 0))
+            {
+                skip++;
+                return true;
+            }
+            if (stack.empty() || isList() || !value(LIST))
+            {
+                return false;
+            }
+            stack.push_back({stack.back().context == ROOT ? RESULTS : POKEMON, 0});
+            return true;
+        }
+        bool end_array()
+        {
+            if (skip > 0)
+            {
+                skip--;
+                return true;
+            }
+            stack.pop_back();
+            return true;
+        }
+
+        template <typename Exception>
+        bool parse_error(size_t, const std::string&, const Exception&)
+        {
+            return false;
+        }
+
+    private:
+        enum Context : u8
+        {
+            ROOT,
+            RESULTS,
+            GROUP,
+            POKEMON,
+            MON
+        };
+        // The fields each kind of object needs, as bits so that a level can keep track of the ones it's seen
+        enum Field : u8
+        {
+            TOTAL      = 1 << 0,
+            PAGES      = 1 << 1,
+            LIST       = 1 << 2,
+            CODE       = 1 << 3,
+            DATA       = 1 << 4,
+            GENERATION = 1 << 5,
+            LEGAL      = 1 << 6
+        };
+        struct Level
+        {
+            Context context;
+            u8 seen;
+        };
+
+        bool isList() const { return stack.back().context == RESULTS || stack.back().context == POKEMON; }
+
+        u8 fieldFor(const std::string& k) const
+        {
+            switch (stack.back().context)
+            {
+                case ROOT:
+                    if (k == (groups ? "total_bundles" : "total_pkm"))
+                    {
+                        return TOTAL;
+                    }
+                    if (k == "pages")
+                    {
+                        return PAGES;
+                    }
+                    if (k == "results")
+                    {
+                        return LIST;
+                    }
+                    break;
+                case GROUP:
+                    if (k == "pokemon")
+                    {
+                        return LIST;
+                    }
+                    if (k == "code")
+                    {
+                        return CODE;
+                    }
+                    break;
+                case MON:
+                    if (k == (groups ? "base64" : "base_64"))
+                    {
+                        return DATA;
+                    }
+                    if (k == "generation")
+                    {
+                        return GENERATION;
+                    }
+                    if (k == "legal")
+                    {
+                        return LEGAL;
+                    }
+                    if (k == "code")
+                    {
+                        return CODE;
+                    }
+                    break;
+                default:
+                    break;
+            }
+            return 0;
+        }
+
+        // Checks a value against the current key. Unknown keys take anything; known ones only the types in allowed, and only once
+        bool value(u8 allowed)
+        {
+            if (skip > 0 || (!stack.empty() && !isList() && field == 0))
+            {
+                return true;
+            }
+            if (stack.empty() || isList() || !(field & allowed) || (stack.back().seen & field))
+            {
+                return false;
+            }
+            stack.back().seen |= field;
+            return true;
+        }
+
+        bool integer(s64 v)
+        {
+            if (!value(TOTAL | PAGES))
+            {
+                return false;
+            }
+            if (field == TOTAL)
+            {
+                page.total = std::clamp(v, (s64)0, (s64)INT_MAX);
+            }
+            else if (field == PAGES)
+            {
+                // Zero pages would make paging divide by zero
+                page.pages = std::clamp(v, (s64)1, (s64)INT_MAX);
+            }
+            return true;
+        }
+
+        GPSSPage& page;
+        std::vector<Level> stack;
+        std::string monData;
+        std::string code;
+        std::string groupCode;
+        Generation monGen = Generation::UNUSED;
+        bool monLegal     = false;
+        bool groups;
+        u8 field = 0;
+        int skip = 0;
+    };
+
+    constexpr u32 STORE_MAGIC   = 0x50535047; // "GPSP"
+    constexpr u32 STORE_VERSION = 1;
+
+    struct StoreHeader
+    {
+        u32 magic;
+        u32 version;
+        s32 pages;
+        s32 total;
+        u32 count;
+        u32 groupCount;
+        u32 dataSize;
+        u32 isGroups;
+    };
+
+    class StoreReader
+    {
+    public:
+        StoreReader(const u8* data, size_t size) : data(data), size(size) {}
+        bool read(void* out, size_t length)
+        {
+            if (length > size - pos)
+            {
+                return false;
+            }
+            std::copy(data + pos, data + pos + length, (u8*)out);
+            pos += length;
+            return true;
+        }
+        template <typename T>
+        bool read(std::vector<T>& out, size_t count)
+        {
+            if (count > (size - pos) / sizeof(T))
+            {
+                return false;
+            }
+            out.resize(count);
+            return read(out.data(), count * sizeof(T));
+        }
+        bool read(std::string& out)
+        {
+            u16 length;
+            if (!read(&length, sizeof(length)) || length > size - pos)
+            {
+                return false;
+            }
+            out.assign((const char*)data + pos, length);
+            pos += length;
+            return true;
+        }
+        bool done() const { return pos == size; }
+
+    private:
+        const u8* data;
+        size_t size;
+        size_t pos = 0;
+    };
+
+    void write(std::vector<u8>& out, const void* data, size_t length)
+    {
+        out.insert(out.end(), (const u8*)data, (const u8*)data + length);
+    }
+
+    void write(std::vector<u8>& out, const std::string& str)
+    {
+        u16 length = std::min(str.size(), (size_t)UINT16_MAX);
+        write(out, &length, sizeof(length));
+        write(out, str.data(), length);
+    }
+
+    // Offsets have to start at zero, never go backwards, and end at the end of what they index
+    bool offsetsGood(const std::vector<u32>& offsets, size_t end)
+    {
+        return !offsets.empty() && offsets.front() == 0 && offsets.back() == end && std::is_sorted(offsets.begin(), offsets.end());
+    }
+
+    std::unique_ptr<GPSSPage> parse(const std::string& body, bool groups)
+    {
+        auto page = std::make_unique<GPSSPage>();
+        PageHandler handler(*page, groups);
+        if (!nlohmann::json::sax_parse(body, &handler))
+        {
+            return nullptr;
+        }
+        return page;
+    }
+}
+
+std::unique_ptr<GPSSPage> GPSSPage::parse(const std::string& body)
+{
+    return ::parse(body, false);
+}
+
+std::unique_ptr<GPSSPage> GPSSPage::parseGroups(const std::string& body)
+{
+    return ::parse(body, true);
+}
+
+const std::vector<std::shared_ptr<PKX>>& GPSSPage::pokemon()
+{
+    if (pkms.size() != size())
+    {
+        pkms.clear();
+        pkms.reserve(size());
+        for (size_t i = 0; i < size(); i++)
+        {
+            pkms.emplace_back(PKX::getPKM(generations[i], data(i), length(i)));
+        }
+    }
+    return pkms;
+}
+
+std::vector<u8> GPSSPage::serialize() const
+{
+    std::vector<u8> out;
+    StoreHeader header = {STORE_MAGIC, STORE_VERSION, pages, total, (u32)size(), (u32)groups(), (u32)pkmData.size(), !groupOffsets.empty()};
+    write(out, &header, sizeof(header));
+    write(out, offsets.data(), offsets.size() * sizeof(u32));
+    write(out, generations.data(), generations.size() * sizeof(Generation));
+    for (bool isLegal : legal)
+    {
+        out.push_back(isLegal ? 1 : 0);
+    }
+    for (auto& code : codes)
+    {
+        write(out, code);
+    }
+    write(out, pkmData.data(), pkmData.size());
+    write(out, groupOffsets.data(), groupOffsets.size() * sizeof(u32));
+    for (auto& code : groupCodes)
+    {
+        write(out, code);
+    }
+    return out;
+}
+
+std::unique_ptr<GPSSPage> GPSSPage::deserialize(const u8* data, size_t size)
+{
+    StoreReader in(data, size);
+    StoreHeader header;
+    if (!in.read(&header, sizeof(header)) || header.magic != STORE_MAGIC || header.version != STORE_VERSION)
+    {
+        return nullptr;
+    }
+
+    auto page   = std::make_unique<GPSSPage>();
+    page->pages = header.pages;
+    page->total = header.total;
+    std::vector<u8> legal;
+    if (!in.read(page->offsets, header.count + 1) || !in.read(page->generations, header.count) || !in.read(legal, header.count))
+    {
+        return nullptr;
+    }
+    page->legal.assign(legal.begin(), legal.end());
+    page->codes.resize(header.count);
+    for (auto& code : page->codes)
+    {
+        if (!in.read(code))
+        {
+            return nullptr;
+        }
+    }
+    if (!in.read(page->pkmData, header.dataSize) || !offsetsGood(page->offsets, header.dataSize))
+    {
+        return nullptr;
+    }
+    if (header.isGroups)
+    {
+        if (!in.read(page->groupOffsets, header.groupCount + 1) || !offsetsGood(page->groupOffsets, header.count))
+        {
+            return nullptr;
+        }
+        page->groupCodes.resize(header.groupCount);
+        for (auto& code : page->groupCodes)
+        {
+            if (!in.read(code))
+            {
+                return nullptr;
+            }
+        }
+    }
+    if (!in.done() || page->pages < 1)
+    {
+        return nullptr;
+    }
+    return page;
+}
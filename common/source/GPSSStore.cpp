@@ -0,0 +1,186 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#include "GPSSStore.hpp"
+#include "diskstore.hpp"
+#include "httpcache.hpp"
+#include "thread.hpp"
+#include <algorithm>
+#include <atomic>
+#include <time.h>
+#include <tuple>
+#include <unistd.h>
+#include <unordered_set>
+
+namespace
+{
+    // Stored pages older than this get refreshed by the sync job
+    constexpr time_t STALE_AGE = 60 * 60;
+    // How often the sync job looks for stale pages while the network is up, on top of right after it comes back
+    constexpr time_t SYNC_INTERVAL = 10 * 60;
+    // Most pages refreshed per sweep, so that coming back from a long time offline doesn't turn into a flood of requests
+    constexpr size_t SYNC_BATCH = 8;
+
+    DiskStore pages("/3ds/PKSM/cache/gpss/");
+    // Pages the sync job is refreshing right now
+    std::unordered_set<std::string> syncing;
+    _LOCK_T syncingMutex;
+    std::atomic<bool> isOnline = true;
+    std::atomic<bool> cameBack = false;
+    std::atomic_flag keepGoing = ATOMIC_FLAG_INIT;
+    std::atomic<bool> running  = false;
+
+    void markOnline(void)
+    {
+        if (!isOnline.exchange(true))
+        {
+            cameBack = true;
+        }
+    }
+
+    void sync(void)
+    {
+        std::vector<std::tuple<u64, std::string, bool>> stale;
+        time_t now = time(nullptr);
+        pages.forEach([&stale, now](const std::string& url, const nlohmann::json& meta, u64 lastUsed) {
+            if (meta.contains("fetched") && meta["fetched"].is_number_integer() && now - meta["fetched"].get<time_t>() >= STALE_AGE)
+            {
+                stale.emplace_back(lastUsed, url, meta.contains("groups") && meta["groups"].is_boolean() && meta["groups"].get<bool>());
+            }
+        });
+        // Most recently used first; those are the ones most likely to be looked at again
+        std::sort(stale.begin(), stale.end(), [](const auto& a, const auto& b) { return std::get<0>(a) > std::get<0>(b); });
+
+        std::vector<std::pair<std::string, bool>> refresh;
+        __lock_acquire(syncingMutex);
+        for (size_t i = 0; i < stale.size() && refresh.size() < SYNC_BATCH; i++)
+        {
+            if (syncing.insert(std::get<1>(stale[i])).second)
+            {
+                refresh.emplace_back(std::get<1>(stale[i]), std::get<2>(stale[i]));
+            }
+        }
+        __lock_release(syncingMutex);
+
+        for (auto& [url, groups] : refresh)
+        {
+            auto done = [url = url, groups = groups](long status, std::string& body) {
+                std::unique_ptr<GPSSPage> page;
+                if (status == 200 && (page = groups ? GPSSPage::parseGroups(body) : GPSSPage::parse(body)))
+                {
+                    GPSSStore::store(url, *page);
+                }
+                else if (status == 0)
+                {
+                    isOnline = false;
+                }
+                else if (status >= 400)
+                {
+                    // The page isn't there anymore, most likely because fewer Pokémon match its filters now
+                    pages.erase(url);
+                }
+                __lock_acquire(syncingMutex);
+                syncing.erase(url);
+                __lock_release(syncingMutex);
+            };
+            if (!HttpCache::getAsync(url, done, Fetch::Priority::BACKGROUND))
+            {
+                __lock_acquire(syncingMutex);
+                syncing.erase(url);
+                __lock_release(syncingMutex);
+            }
+        }
+    }
+
+    void syncThread(void*)
+    {
+        // Pages stored by earlier runs can wait until they're looked at or the network comes back; this shouldn't add requests to every boot
+        time_t lastSweep = time(nullptr);
+        while (keepGoing.test_and_set())
+        {
+            if (isOnline && (cameBack.exchange(false) || time(nullptr) - lastSweep >= SYNC_INTERVAL))
+            {
+                lastSweep = time(nullptr);
+                sync();
+            }
+            usleep(500'000);
+        }
+        running = false;
+    }
+}
+
+void GPSSStore::init(size_t maxSize)
+{
+    __lock_init(syncingMutex);
+    pages.open(maxSize);
+
+    keepGoing.test_and_set();
+    running = Threads::create(syncThread, nullptr, 8 * 1024);
+}
+
+void GPSSStore::exit(void)
+{
+    keepGoing.clear();
+    while (running)
+    {
+        usleep(100);
+    }
+
+    // Refreshes still in flight may finish after this; the closed store ignores them
+    pages.close();
+}
+
+void GPSSStore::store(const std::string& url, const GPSSPage& page)
+{
+    markOnline();
+
+    // Pages are stored from Fetch callbacks, so the SD card write is left to the store's worker
+    std::vector<u8> data = page.serialize();
+    pages.putLater(url, std::string(data.begin(), data.end()), {{"fetched", time(nullptr)}, {"groups", !page.groupOffsets.empty()}});
+}
+
+std::unique_ptr<GPSSPage> GPSSStore::load(const std::string& url)
+{
+    isOnline = false;
+
+    std::unique_ptr<GPSSPage> ret;
+    std::string data;
+    if (pages.get(url, data) && !(ret = GPSSPage::deserialize((const u8*)data.data(), data.size())))
+    {
+        pages.erase(url);
+    }
+    return ret;
+}
+
+bool GPSSStore::contains(const std::string& url)
+{
+    return pages.contains(url);
+}
+
+bool GPSSStore::online(void)
+{
+    return isOnline;
+}
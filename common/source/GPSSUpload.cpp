@@ -0,0 +1,291 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#include "GPSSUpload.hpp"
+#include "Configuration.hpp"
+#include "PKX.hpp"
+#include "base64.hpp"
+#include "fetch.hpp"
+#include "nlohmann/json.hpp"
+#include "thread.hpp"
+#include <algorithm>
+#include <atomic>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+    struct Upload
+    {
+        Generation generation;
+        std::vector<u8> data;
+        int attempts   = 0;
+        time_t retryAt = 0;
+        bool active    = false;
+    };
+
+    struct UploadRequest
+    {
+        std::string response;
+        struct curl_slist* headers = nullptr;
+        std::unique_ptr<curl_mime, decltype(curl_mime_free)*> mime{nullptr, &curl_mime_free};
+        ~UploadRequest() { curl_slist_free_all(headers); }
+    };
+
+    constexpr const char* QUEUE_PATH = "/3ds/PKSM/cache/uploads.json";
+    // Backoff starts here and doubles with every failed attempt, up to MAX_BACKOFF
+    constexpr time_t BASE_BACKOFF = 2;
+    constexpr time_t MAX_BACKOFF  = 5 * 60;
+    // After this many failed attempts, an upload is given up on
+    constexpr int MAX_ATTEMPTS = 8;
+
+    std::vector<std::shared_ptr<Upload>> uploads;
+    _LOCK_T uploadsMutex;
+    size_t maxActive           = GPSSUpload::DEFAULT_MAX_CONCURRENT;
+    size_t active              = 0;
+    bool anySucceeded          = false;
+    std::atomic<u32> batches   = 0;
+    std::atomic_flag keepGoing = ATOMIC_FLAG_INIT;
+    std::atomic<bool> running  = false;
+
+    // Must be called with uploadsMutex held
+    void save(void)
+    {
+        nlohmann::json json = nlohmann::json::array();
+        for (auto& upload : uploads)
+        {
+            json.push_back({{"generation", genToString(upload->generation)}, {"data", base64_encode(upload->data)}});
+        }
+        std::string data = json.dump();
+        FILE* out        = fopen(QUEUE_PATH, "wb");
+        if (out)
+        {
+            fwrite(data.data(), 1, data.size(), out);
+            fclose(out);
+        }
+    }
+
+    // Must be called with uploadsMutex held
+    void finish(std::shared_ptr<Upload> upload, bool succeeded)
+    {
+        auto found = std::find(uploads.begin(), uploads.end(), upload);
+        // Already saved and dropped by exit
+        if (found == uploads.end())
+        {
+            return;
+        }
+        uploads.erase(found);
+        anySucceeded |= succeeded;
+        if (uploads.empty())
+        {
+            if (anySucceeded)
+            {
+                batches++;
+            }
+            anySucceeded = false;
+            remove(QUEUE_PATH);
+        }
+    }
+
+    // Usually called on the Fetch thread, so it can't start anything new; uploadThread does that
+    void done(std::shared_ptr<Upload> upload, CURLcode code, std::shared_ptr<Fetch> fetch)
+    {
+        long status = 0;
+        if (code == CURLE_OK)
+        {
+            fetch->getinfo(CURLINFO_RESPONSE_CODE, &status);
+        }
+
+        __lock_acquire(uploadsMutex);
+        active--;
+        upload->active = false;
+        // Only connection problems, rate limits and server trouble are worth trying again; anything else would just be refused again
+        bool retry = status == 0 || status == 429 || status >= 500;
+        if (status == 201 || !retry || ++upload->attempts >= MAX_ATTEMPTS)
+        {
+            finish(upload, status == 201);
+        }
+        else
+        {
+            upload->retryAt = time(nullptr) + std::min(BASE_BACKOFF << (upload->attempts - 1), MAX_BACKOFF);
+        }
+        __lock_release(uploadsMutex);
+    }
+
+    bool start(std::shared_ptr<Upload> upload)
+    {
+        auto request           = std::make_shared<UploadRequest>();
+        std::string generation = "Generation: " + genToString(upload->generation);
+        std::string code       = Configuration::getInstance().patronCode();
+        request->headers       = curl_slist_append(request->headers, "Content-Type: multipart/form-data");
+        request->headers       = curl_slist_append(request->headers, generation.c_str());
+        if (!code.empty())
+        {
+            request->headers = curl_slist_append(request->headers, ("PC: " + code).c_str());
+        }
+
+        auto fetch = Fetch::init(Configuration::getInstance().gpssServer() + "/gpss/share", true, &request->response, request->headers, "");
+        if (!fetch)
+        {
+            return false;
+        }
+        request->mime        = fetch->mimeInit();
+        curl_mimepart* field = curl_mime_addpart(request->mime.get());
+        curl_mime_name(field, "pkmn");
+        curl_mime_data(field, (char*)upload->data.data(), upload->data.size());
+        curl_mime_filename(field, "pkmn");
+        fetch->setopt(CURLOPT_MIMEPOST, request->mime.get());
+
+        // Nobody is waiting on these, so they step aside for anything the user is and only take Fetch's background slots
+        return Fetch::performAsync(fetch, [upload, request](CURLcode code, std::shared_ptr<Fetch> fetch) { done(upload, code, fetch); },
+                   Fetch::Priority::BACKGROUND) == CURLM_OK;
+    }
+
+    void uploadThread(void*)
+    {
+        while (keepGoing.test_and_set())
+        {
+            std::vector<std::shared_ptr<Upload>> startMe;
+            __lock_acquire(uploadsMutex);
+            time_t now = time(nullptr);
+            for (size_t i = 0; i < uploads.size() && active < maxActive; i++)
+            {
+                if (!uploads[i]->active && uploads[i]->retryAt <= now)
+                {
+                    uploads[i]->active = true;
+                    active++;
+                    startMe.emplace_back(uploads[i]);
+                }
+            }
+            __lock_release(uploadsMutex);
+
+            // Not under uploadsMutex: done holds Fetch's locks while it takes uploadsMutex, so this has to take them in the same order
+            for (auto& upload : startMe)
+            {
+                if (!start(upload))
+                {
+                    done(upload, CURLE_FAILED_INIT, nullptr);
+                }
+            }
+            usleep(100'000);
+        }
+        running = false;
+    }
+}
+
+void GPSSUpload::init(void)
+{
+    __lock_init(uploadsMutex);
+
+    FILE* in = fopen(QUEUE_PATH, "rb");
+    if (in)
+    {
+        fseek(in, 0, SEEK_END);
+        size_t size = ftell(in);
+        rewind(in);
+        std::string data(size, '\0');
+        fread(data.data(), 1, size, in);
+        fclose(in);
+
+        nlohmann::json saved = nlohmann::json::parse(data, nullptr, false);
+        if (saved.is_array())
+        {
+            for (auto& json : saved)
+            {
+                // clang-format off
+                if (!json.is_object() ||
+                    !json.contains("generation") || !json["generation"].is_string() ||
+                    !json.contains("data") || !json["data"].is_string())
+                // clang-format on
+                {
+                    continue;
+                }
+                auto upload        = std::make_shared<Upload>();
+                upload->generation = stringToGen(json["generation"].get<std::string>());
+                upload->data       = base64_decode(json["data"].get<std::string>());
+                uploads.emplace_back(upload);
+            }
+        }
+    }
+
+    keepGoing.test_and_set();
+    running = Threads::create(uploadThread, nullptr, 8 * 1024);
+}
+
+void GPSSUpload::exit(void)
+{
+    keepGoing.clear();
+    while (running)
+    {
+        usleep(100);
+    }
+
+    // Whatever's still in flight gets cut off when Fetch exits, so it's saved along with the rest
+    __lock_acquire(uploadsMutex);
+    if (!uploads.empty())
+    {
+        save();
+    }
+    uploads.clear();
+    __lock_release(uploadsMutex);
+}
+
+void GPSSUpload::queue(const std::vector<std::shared_ptr<PKX>>& pokemon)
+{
+    __lock_acquire(uploadsMutex);
+    for (auto& pkm : pokemon)
+    {
+        if (pkm && pkm->species() != 0)
+        {
+            auto upload        = std::make_shared<Upload>();
+            upload->generation = pkm->generation();
+            upload->data       = std::vector<u8>(pkm->rawData(), pkm->rawData() + pkm->getLength());
+            uploads.emplace_back(upload);
+        }
+    }
+    save();
+    __lock_release(uploadsMutex);
+}
+
+void GPSSUpload::maxConcurrent(size_t max)
+{
+    __lock_acquire(uploadsMutex);
+    maxActive = std::max(max, (size_t)1);
+    __lock_release(uploadsMutex);
+}
+
+size_t GPSSUpload::pending(void)
+{
+    __lock_acquire(uploadsMutex);
+    size_t ret = uploads.size();
+    __lock_release(uploadsMutex);
+    return ret;
+}
+
+u32 GPSSUpload::batchesDone(void)
+{
+    return batches;
+}
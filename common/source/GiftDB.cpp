@@ -0,0 +1,456 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#include "GiftDB.hpp"
+#include "nlohmann/json.hpp"
+#include <algorithm>
+#include <array>
+#include <bzlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unordered_map>
+
+namespace
+{
+    // Strings are stored once no matter how many cards use them, which matters for game names
+    class StringPool
+    {
+    public:
+        u32 add(const std::string& str)
+        {
+            auto found = offsets.find(str);
+            if (found != offsets.end())
+            {
+                return found->second;
+            }
+            u32 ret = pool.size();
+            pool.insert(pool.end(), str.begin(), str.end());
+            pool.push_back('\0');
+            offsets.emplace(str, ret);
+            return ret;
+        }
+        const std::vector<char>& data() const { return pool; }
+
+    private:
+        std::vector<char> pool;
+        std::unordered_map<std::string, u32> offsets;
+    };
+
+    constexpr size_t CHUNK_SIZE = 16 * 1024;
+
+    constexpr std::array<u32, 256> CRC_TABLE = [] {
+        std::array<u32, 256> ret{};
+        for (u32 i = 0; i < ret.size(); i++)
+        {
+            u32 crc = i;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = crc & 1 ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+            }
+            ret[i] = crc;
+        }
+        return ret;
+    }();
+
+    // The same CRC-32 as zlib's. Pass the previous result as crc to continue it over more data
+    u32 crc32(const void* data, size_t size, u32 crc = 0)
+    {
+        const u8* bytes = (const u8*)data;
+        crc             = ~crc;
+        for (size_t i = 0; i < size; i++)
+        {
+            crc = CRC_TABLE[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    template <typename T>
+    u32 crc32(const std::vector<T>& section, u32 crc)
+    {
+        return crc32(section.data(), section.size() * sizeof(T), crc);
+    }
+
+    u32 indexChecksum(const std::vector<GiftDB::Card>& cards, const std::vector<GiftDB::Match>& matches, const std::vector<u32>& matchCards,
+        const std::vector<char>& strings)
+    {
+        return crc32(strings, crc32(matchCards, crc32(matches, crc32(cards, 0))));
+    }
+
+    // Decompresses a .bz2 file a chunk at a time and hands every chunk of output to sink, so that nothing has to be sized up front.
+    // Anything else is handed over as it is
+    template <typename Sink>
+    bool decompress(const std::string& path, Sink&& sink)
+    {
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f)
+        {
+            return false;
+        }
+        if (path.size() < 4 || path.compare(path.size() - 4, 4, ".bz2") != 0)
+        {
+            std::vector<char> in(CHUNK_SIZE);
+            bool ok = true;
+            size_t read;
+            while (ok && (read = fread(in.data(), 1, in.size(), f)) > 0)
+            {
+                ok = sink(in.data(), read);
+            }
+            ok = ok && !ferror(f);
+            fclose(f);
+            return ok;
+        }
+
+        bz_stream stream{};
+        if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK)
+        {
+            fclose(f);
+            return false;
+        }
+
+        std::vector<char> in(CHUNK_SIZE), out(CHUNK_SIZE);
+        int r = BZ_OK;
+        while (r == BZ_OK)
+        {
+            if (stream.avail_in == 0)
+            {
+                stream.next_in  = in.data();
+                stream.avail_in = fread(in.data(), 1, in.size(), f);
+                // A file that ends before the stream does is truncated
+                if (stream.avail_in == 0)
+                {
+                    break;
+                }
+            }
+            stream.next_out  = out.data();
+            stream.avail_out = out.size();
+            r                = BZ2_bzDecompress(&stream);
+            if ((r == BZ_OK || r == BZ_STREAM_END) && !sink(out.data(), out.size() - stream.avail_out))
+            {
+                r = BZ_IO_ERROR;
+            }
+        }
+
+        BZ2_bzDecompressEnd(&stream);
+        fclose(f);
+        return r == BZ_STREAM_END;
+    }
+
+    bool cardType(const std::string& gen, const std::string& type, GiftDB::CardType& out)
+    {
+        bool full = type.find("full") != std::string::npos;
+        if (gen == "4")
+        {
+            out = type == "wc4" ? GiftDB::CardType::WC4 : GiftDB::CardType::PGT;
+        }
+        else if (gen == "5")
+        {
+            out = GiftDB::CardType::PGF;
+        }
+        else if (gen == "6")
+        {
+            out = full ? GiftDB::CardType::WC6FULL : GiftDB::CardType::WC6;
+        }
+        else if (gen == "7")
+        {
+            out = full ? GiftDB::CardType::WC7FULL : GiftDB::CardType::WC7;
+        }
+        else if (gen == "LGPE")
+        {
+            out = full ? GiftDB::CardType::WB7FULL : GiftDB::CardType::WB7;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    template <typename T>
+    bool writeSection(FILE* f, const std::vector<T>& section)
+    {
+        return section.empty() || fwrite(section.data(), sizeof(T), section.size(), f) == section.size();
+    }
+
+    template <typename T>
+    bool readSection(FILE* f, std::vector<T>& section, size_t count)
+    {
+        section.resize(count);
+        return count == 0 || fread(section.data(), sizeof(T), count, f) == count;
+    }
+
+    bool buildIndex(const std::string& sheetPath, std::vector<GiftDB::Card>& cards, std::vector<GiftDB::Match>& matches,
+        std::vector<u32>& matchCards, StringPool& strings, const std::atomic<bool>* cancelled)
+    {
+        nlohmann::json sheet;
+        {
+            std::vector<char> sheetData;
+            if (!decompress(sheetPath, [&sheetData, cancelled](const char* chunk, size_t size) {
+                    sheetData.insert(sheetData.end(), chunk, chunk + size);
+                    return !cancelled || !*cancelled;
+                }))
+            {
+                return false;
+            }
+            sheet = nlohmann::json::parse(sheetData.begin(), sheetData.end(), nullptr, false);
+        }
+
+        // clang-format off
+        if (sheet.is_discarded() || !sheet.is_object() ||
+            !(sheet.contains("gen") && sheet["gen"].is_string()) ||
+            !(sheet.contains("wondercards") && sheet["wondercards"].is_array()) ||
+            !(sheet.contains("matches") && sheet["matches"].is_array()))
+        // clang-format on
+        {
+            return false;
+        }
+
+        const std::string gen = sheet["gen"];
+        cards.reserve(sheet["wondercards"].size());
+        for (auto& entry : sheet["wondercards"])
+        {
+            // clang-format off
+            if (!entry.is_object() ||
+                !(entry.contains("type") && entry["type"].is_string()) ||
+                !(entry.contains("offset") && entry["offset"].is_number_unsigned()) ||
+                !(entry.contains("size") && entry["size"].is_number_unsigned()) ||
+                !(entry.contains("name") && entry["name"].is_string()) ||
+                !(entry.contains("game") && entry["game"].is_string()) ||
+                !(entry.contains("species") && entry["species"].is_number_integer()) ||
+                !(entry.contains("form") && entry["form"].is_number_integer()) ||
+                (entry.contains("gender") && !entry["gender"].is_number_integer()))
+            // clang-format on
+            {
+                return false;
+            }
+
+            GiftDB::Card card{};
+            if (!cardType(gen, entry["type"], card.type))
+            {
+                return false;
+            }
+            card.offset  = entry["offset"];
+            card.size    = entry["size"];
+            card.name    = strings.add(entry["name"]);
+            card.game    = strings.add(entry["game"]);
+            card.species = entry["species"].get<int>();
+            card.form    = entry["form"].get<int>();
+            card.gender  = entry.value("gender", -1);
+            cards.push_back(card);
+        }
+
+        // The sheet only says which language a card is in through the matches, so that's where the cards get theirs
+        matches.reserve(sheet["matches"].size());
+        for (auto& match : sheet["matches"])
+        {
+            if (!match.is_object())
+            {
+                return false;
+            }
+            GiftDB::Match out{u32(matchCards.size()), 0};
+            for (auto& [lang, index] : match.items())
+            {
+                if (lang.size() != sizeof(GiftDB::Card::language) || !index.is_number_unsigned() || index.get<size_t>() >= cards.size())
+                {
+                    return false;
+                }
+                memcpy(cards[index.get<size_t>()].language, lang.data(), lang.size());
+                matchCards.push_back(index.get<u32>());
+                out.count++;
+            }
+            if (out.count > 0)
+            {
+                matches.push_back(out);
+            }
+        }
+
+        return true;
+    }
+}
+
+GiftDB::Source GiftDB::source(const std::string& path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+        return {0, 0};
+    }
+    return {u32(info.st_size), u32(info.st_mtime)};
+}
+
+bool GiftDB::convert(const std::string& sheetPath, const std::string& dataPath, const std::string& outPath, const std::atomic<bool>* cancelled)
+{
+    remove(outPath.c_str());
+
+    std::vector<Card> cards;
+    std::vector<Match> matches;
+    std::vector<u32> matchCards;
+    StringPool strings;
+    if (!buildIndex(sheetPath, cards, matches, matchCards, strings, cancelled))
+    {
+        return false;
+    }
+
+    Header header{MAGIC, VERSION, source(sheetPath), source(dataPath), u32(cards.size()), u32(matches.size()), u32(matchCards.size()),
+        u32(strings.data().size()), 0, 0};
+
+    std::string tempPath = outPath + ".tmp";
+    FILE* out            = fopen(tempPath.c_str(), "w+b");
+    if (!out)
+    {
+        return false;
+    }
+
+    // The card data is decompressed straight into the database, and its size only filled in once it's known. bzip2 checks its own
+    // CRCs, so a truncated or corrupt download fails here
+    u64 dataSize = 0;
+    bool ok      = fwrite(&header, sizeof(header), 1, out) == 1 && writeSection(out, cards) && writeSection(out, matches) &&
+              writeSection(out, matchCards) && writeSection(out, strings.data()) &&
+              decompress(dataPath, [out, &dataSize, cancelled](const char* chunk, size_t size) {
+                  dataSize += size;
+                  return fwrite(chunk, 1, size, out) == size && (!cancelled || !*cancelled);
+              });
+    ok = ok && dataSize <= UINT32_MAX && std::all_of(cards.begin(), cards.end(), [dataSize](const Card& card) {
+        return card.offset <= dataSize && card.size <= dataSize - card.offset;
+    });
+
+    // Checksums are taken from what was actually written, going through the cards in the order they're stored in
+    if (ok)
+    {
+        const long dataStart = sizeof(Header) + cards.size() * sizeof(Card) + matches.size() * sizeof(Match) + matchCards.size() * sizeof(u32) +
+                               strings.data().size();
+        std::vector<size_t> order(cards.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&cards](size_t a, size_t b) { return cards[a].offset < cards[b].offset; });
+        std::vector<u8> card;
+        for (size_t i = 0; ok && i < order.size(); i++)
+        {
+            card.resize(cards[order[i]].size);
+            ok = fseek(out, dataStart + cards[order[i]].offset, SEEK_SET) == 0 &&
+                 (card.empty() || fread(card.data(), 1, card.size(), out) == card.size());
+            cards[order[i]].checksum = crc32(card.data(), card.size());
+        }
+    }
+    if (ok)
+    {
+        header.dataSize      = dataSize;
+        header.indexChecksum = indexChecksum(cards, matches, matchCards, strings.data());
+        ok = fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1 && writeSection(out, cards);
+    }
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(tempPath.c_str(), outPath.c_str()) != 0)
+    {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool GiftDB::Database::open(const std::string& path)
+{
+    close();
+
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        return false;
+    }
+
+    // Checking the section sizes against the file's size first means a truncated or garbled header can't ask for huge allocations
+    fseek(f, 0, SEEK_END);
+    u64 fileSize = ftell(f);
+    rewind(f);
+    Header h;
+    // clang-format off
+    if (fread(&h, sizeof(h), 1, f) != 1 || h.magic != MAGIC || h.version != VERSION ||
+        fileSize != sizeof(Header) + u64(h.cardCount) * sizeof(Card) + u64(h.matchCount) * sizeof(Match) +
+            u64(h.matchCardCount) * sizeof(u32) + h.stringsSize + h.dataSize ||
+        !readSection(f, cardTable, h.cardCount) || !readSection(f, matchTable, h.matchCount) ||
+        !readSection(f, matchCards, h.matchCardCount) || !readSection(f, strings, h.stringsSize) ||
+        (!strings.empty() && strings.back() != '\0') ||
+        indexChecksum(cardTable, matchTable, matchCards, strings) != h.indexChecksum)
+    // clang-format on
+    {
+        fclose(f);
+        close();
+        return false;
+    }
+
+    // The checksum should have caught anything wrong, but these are cheap enough that nothing is read out of bounds even if it didn't
+    bool inBounds = std::all_of(cardTable.begin(), cardTable.end(), [&h](const Card& card) {
+        return card.offset <= h.dataSize && card.size <= h.dataSize - card.offset && card.name < h.stringsSize && card.game < h.stringsSize;
+    });
+    inBounds = inBounds && std::all_of(matchTable.begin(), matchTable.end(), [&h](const Match& match) {
+        return match.first <= h.matchCardCount && match.count <= h.matchCardCount - match.first;
+    });
+    inBounds = inBounds && std::all_of(matchCards.begin(), matchCards.end(), [&h](u32 card) { return card < h.cardCount; });
+    if (!inBounds)
+    {
+        fclose(f);
+        close();
+        return false;
+    }
+
+    header    = h;
+    dataStart = ftell(f);
+    file      = f;
+    return true;
+}
+
+void GiftDB::Database::close(void)
+{
+    if (file)
+    {
+        fclose(file);
+        file = nullptr;
+    }
+    header = Header{};
+    cardTable.clear();
+    cardTable.shrink_to_fit();
+    matchTable.clear();
+    matchTable.shrink_to_fit();
+    matchCards.clear();
+    matchCards.shrink_to_fit();
+    strings.clear();
+    strings.shrink_to_fit();
+}
+
+std::vector<u8> GiftDB::Database::data(size_t index) const
+{
+    std::vector<u8> ret;
+    if (file && index < cardTable.size())
+    {
+        ret.resize(cardTable[index].size);
+        if (fseek(file, dataStart + cardTable[index].offset, SEEK_SET) != 0 || fread(ret.data(), 1, ret.size(), file) != ret.size() ||
+            crc32(ret.data(), ret.size()) != cardTable[index].checksum)
+        {
+            ret.clear();
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,191 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#include "GiftDelta.hpp"
+#include "GiftDB.hpp"
+#include "fetch.hpp"
+#include "format.h"
+#include "sha256.h"
+#include <stdint.h>
+#include <string.h>
+#include <sys/lock.h>
+#include <unordered_map>
+#include <vector>
+
+bool GiftDelta::apply(const std::string& manifest, const u8* archiveHash, const std::string& databasePath, const std::string& cardsURL,
+    const std::string& outPath)
+{
+    GiftDB::ManifestHeader header;
+    if (manifest.size() < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, manifest.data(), sizeof(header));
+    // clang-format off
+    if (header.magic != GiftDB::MANIFEST_MAGIC || header.version != GiftDB::MANIFEST_VERSION ||
+        memcmp(header.archiveHash, archiveHash, sizeof(header.archiveHash)) != 0 ||
+        manifest.size() != sizeof(header) + u64(header.cardCount) * sizeof(GiftDB::ManifestCard))
+    // clang-format on
+    {
+        return false;
+    }
+    std::vector<GiftDB::ManifestCard> cards(header.cardCount);
+    if (!cards.empty())
+    {
+        memcpy(cards.data(), manifest.data() + sizeof(header), cards.size() * sizeof(GiftDB::ManifestCard));
+    }
+
+    // Whatever the local database has is reused, going by content alone, so it doesn't matter which files it was converted from
+    GiftDB::Database database;
+    database.open(databasePath);
+    std::unordered_map<std::string, size_t> local;
+    for (size_t i = 0; i < database.cards(); i++)
+    {
+        std::vector<u8> data = database.data(i);
+        std::string hash(SHA256_BLOCK_SIZE, '\0');
+        sha256((u8*)hash.data(), data.data(), data.size());
+        local.emplace(std::move(hash), i);
+    }
+
+    std::unordered_map<std::string, std::string> downloaded;
+    for (auto& card : cards)
+    {
+        std::string hash((const char*)card.hash, sizeof(card.hash));
+        if (!local.count(hash))
+        {
+            downloaded.emplace(std::move(hash), std::string{});
+        }
+    }
+    // Past this, the cards' own requests cost more than downloading the whole file at once
+    if (downloaded.size() > cards.size() / 4)
+    {
+        return false;
+    }
+
+    struct CardDownload
+    {
+        const std::string* hash;
+        std::string* body;
+        long status;
+    };
+    std::vector<CardDownload> downloads;
+    downloads.reserve(downloaded.size());
+    for (auto& [hash, body] : downloaded)
+    {
+        downloads.push_back({&hash, &body, 0});
+    }
+
+    // This runs while PKSM is in use, so the cards go at background priority: the cap on those keeps them from crowding out anything the
+    // user is waiting on, and they pause while it's going
+    _LOCK_T finishedMutex;
+    __lock_init(finishedMutex);
+    _COND_T allFinished = __COND_INITIALIZER;
+    size_t started = 0, finished = 0;
+    for (auto& download : downloads)
+    {
+        std::string name;
+        for (u8 byte : *download.hash)
+        {
+            name += fmt::format("{:02x}", byte);
+        }
+        if (auto fetch = Fetch::init(cardsURL + name, true, download.body, nullptr, ""))
+        {
+            auto done = [&download, &finished, &finishedMutex, &allFinished](CURLcode code, std::shared_ptr<Fetch> fetch) {
+                fetch->getinfo(CURLINFO_RESPONSE_CODE, &download.status);
+                __lock_acquire(finishedMutex);
+                finished++;
+                __cond_signal(allFinished);
+                __lock_release(finishedMutex);
+            };
+            if (Fetch::performAsync(fetch, done, Fetch::Priority::BACKGROUND) == CURLM_OK)
+            {
+                started++;
+            }
+        }
+    }
+    __lock_acquire(finishedMutex);
+    while (finished != started)
+    {
+        __cond_wait(allFinished, finishedMutex, UINT64_MAX);
+    }
+    __lock_release(finishedMutex);
+    __lock_close(finishedMutex);
+    for (auto& download : downloads)
+    {
+        u8 hash[SHA256_BLOCK_SIZE];
+        sha256(hash, (const u8*)download.body->data(), download.body->size());
+        if (download.status != 200 || memcmp(hash, download.hash->data(), sizeof(hash)) != 0)
+        {
+            return false;
+        }
+    }
+
+    // Laid out in the manifest's order, the cards are exactly the decompressed dataN.bin.bz2, so the sheet's offsets still apply
+    const std::string partPath = outPath + ".part";
+    FILE* out                  = fopen(partPath.c_str(), "wb");
+    if (!out)
+    {
+        return false;
+    }
+    SHA256_CTX context;
+    sha256_init(&context);
+    bool ok = true;
+    for (size_t i = 0; ok && i < cards.size(); i++)
+    {
+        std::string hash((const char*)cards[i].hash, sizeof(cards[i].hash));
+        auto found = local.find(hash);
+        std::vector<u8> data;
+        if (found != local.end())
+        {
+            data = database.data(found->second);
+        }
+        else
+        {
+            const std::string& body = downloaded[hash];
+            data.assign(body.begin(), body.end());
+        }
+        ok = data.size() == cards[i].size && fwrite(data.data(), 1, data.size(), out) == data.size();
+        sha256_update(&context, data.data(), data.size());
+    }
+    ok = fclose(out) == 0 && ok;
+
+    u8 dataHash[SHA256_BLOCK_SIZE];
+    sha256_final(&context, dataHash);
+    if (ok && memcmp(dataHash, header.dataHash, sizeof(dataHash)) == 0)
+    {
+        remove(outPath.c_str());
+        ok = rename(partPath.c_str(), outPath.c_str()) == 0;
+    }
+    else
+    {
+        ok = false;
+    }
+    if (!ok)
+    {
+        remove(partPath.c_str());
+    }
+    return ok;
+}
@@ -26,249 +26,62 @@
 
 #include "GroupCloudAccess.hpp"
 #include "Configuration.hpp"
+#include "DownloadCounter.hpp"
+#include "GPSSStore.hpp"
 #include "PB7.hpp"
 #include "PK4.hpp"
 #include "PK5.hpp"
 #include "PK6.hpp"
 #include "PK7.hpp"
 #include "PK8.hpp"
-#include "base64.hpp"
 #include "fetch.hpp"
 #include "format.h"
-#include "nlohmann/json.hpp"
-#include <unistd.h>
 
-GroupCloudAccess::Page::~Page() {}
-
-void GroupCloudAccess::downloadGroupPage(std::shared_ptr<Page> page, int number, bool legal, Generation low, Generation high, bool LGPE)
+PagedCollection<GroupCloudAccess::FilterKey, GPSSPage>::Source GroupCloudAccess::pageSource()
 {
-    std::string* retData = new std::string;
-    auto fetch           = Fetch::init(GroupCloudAccess::makeURL(number, legal, low, high, LGPE), true, retData, nullptr, "");
-    Fetch::performAsync(fetch, [page, retData](CURLcode code, std::shared_ptr<Fetch> fetch) {
-        if (code == CURLE_OK)
+    PagedCollection<FilterKey, GPSSPage>::Source source;
+    source.url      = [](const FilterKey& key, int number) { return makeURL(number, key.legal, key.low, key.high, key.LGPE); };
+    source.decode   = GPSSPage::parseGroups;
+    source.received = [](const std::string& url, GPSSPage& data, bool fresh) {
+        if (fresh || !GPSSStore::contains(url))
         {
-            long status_code;
-            fetch->getinfo(CURLINFO_RESPONSE_CODE, &status_code);
-            switch (status_code)
-            {
-                case 200:
-                    page->data = std::make_unique<nlohmann::json>(nlohmann::json::parse(*retData, nullptr, false));
-                    // clang-format off
-                    if (!page->data || !page->data->is_object() ||
-                        !page->data->contains("total_bundles") || !(*page->data)["total_bundles"].is_number_integer() ||
-                        !page->data->contains("pages") || !(*page->data)["pages"].is_number_integer() ||
-                        !page->data->contains("results") || !(*page->data)["results"].is_array())
-                    // clang-format on
-                    {
-                        page->data = nullptr;
-                    }
-                    else
-                    {
-                        for (auto& group : (*page->data)["results"])
-                        {
-                            // clang-format off
-                            if (!group.is_object() ||
-                                !group.contains("pokemon") || !group["pokemon"].is_array() ||
-                                !group.contains("code") || !group["code"].is_string())
-                            // clang-format on
-                            {
-                                page->data = nullptr;
-                                break;
-                            }
-                            else
-                            {
-                                bool shouldBreak = false;
-                                for (auto& pkm : group["pokemon"])
-                                {
-                                    // clang-format off
-                                    if (!pkm.is_object() ||
-                                        !pkm.contains("base64") || !pkm["base64"].is_string() ||
-                                        !pkm.contains("generation") || !pkm["generation"].is_string() ||
-                                        !pkm.contains("legal") || !pkm["legal"].is_boolean() ||
-                                        !pkm.contains("code") || !pkm["code"].is_string())
-                                    // clang-format on
-                                    {
-                                        page->data  = nullptr;
-                                        shouldBreak = true;
-                                        break;
-                                    }
-                                }
-                                if (shouldBreak)
-                                {
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    break;
-                default:
-                    break;
-            }
-        }
-        delete retData;
-        page->available = true;
-    });
-}
-
-GroupCloudAccess::GroupCloudAccess() : pageNumber(1)
-{
-    refreshPages();
-}
-
-void GroupCloudAccess::refreshPages()
-{
-    current            = std::make_shared<Page>();
-    current->data      = std::make_unique<nlohmann::json>(grabPage(pageNumber));
-    current->available = true;
-    isGood             = (bool)current->data && !current->data->is_discarded();
-    if (isGood && pageNumber >= pages())
-    {
-        pageNumber         = pages();
-        current->data      = std::make_unique<nlohmann::json>(grabPage(pages()));
-        current->available = true;
-        isGood             = (bool)current->data && !current->data->is_discarded();
-    }
-    if (isGood)
-    {
-        if (pages() > 1)
-        {
-            int page = (pageNumber % pages()) + 1;
-            next     = std::make_shared<Page>();
-            downloadGroupPage(next, page, legal, low, high, LGPE);
-            if (pages() > 2)
-            {
-                page = pageNumber - 1 == 0 ? pages() : pageNumber - 1;
-                prev = std::make_shared<Page>();
-                downloadGroupPage(prev, page, legal, low, high, LGPE);
-            }
-            else
-            {
-                prev = next;
-            }
+            GPSSStore::store(url, data);
         }
-        else
+        // Build the Pokémon now, off the UI thread, so that drawing a group doesn't decode anything
+        data.pokemon();
+    };
+    source.fallback = [](const std::string& url) {
+        auto data = GPSSStore::load(url);
+        if (data)
         {
-            next = prev = current;
+            data->pokemon();
         }
-    }
+        return data;
+    };
+    source.online = GPSSStore::online;
+    return source;
 }
 
-nlohmann::json GroupCloudAccess::grabPage(int num)
+GroupCloudAccess::GroupCloudAccess() : collection(pageSource(), 12, 1)
 {
-    std::string retData;
-    auto fetch = Fetch::init(makeURL(num, legal, low, high, LGPE), true, &retData, nullptr, "");
-    auto res   = Fetch::perform(fetch);
-    if (res.index() == 0)
-    {
-        return {};
-    }
-    else if (std::get<1>(res) == CURLE_OK)
-    {
-        long status_code;
-        fetch->getinfo(CURLINFO_RESPONSE_CODE, &status_code);
-        switch (status_code)
-        {
-            case 200:
-                break;
-            default:
-                return {};
-        }
-        return nlohmann::json::parse(retData, nullptr, false);
-    }
-    else
-    {
-        return {};
-    }
+    collection.show(key(), 1);
 }
 
 std::string GroupCloudAccess::makeURL(int num, bool legal, Generation low, Generation high, bool LGPE)
 {
-    return "https://flagbrew.org/api/v1/gpss/bundles/all?count=" + std::to_string(NUM_GROUPS) + "&min_gen=" + genToString(low) +
-           "&max_gen=" + genToString(high) + "&lgpe=" + (LGPE ? std::string("yes") : std::string("no")) + "&page=" + std::to_string(num) +
-           (legal ? "&legal_only=yes" : "");
-}
-
-bool GroupCloudAccess::nextPage()
-{
-    while (!next->available)
-    {
-        usleep(100);
-    }
-    if (!next->data || next->data->is_discarded())
-    {
-        return isGood = false;
-    }
-    // Update data
-    pageNumber = (pageNumber % pages()) + 1;
-    prev       = current;
-    current    = next;
-    next       = std::make_shared<Page>();
-
-    // Download next page in the background
-    int nextPage = (pageNumber % pages()) + 1;
-    downloadGroupPage(next, nextPage, legal, low, high, LGPE);
-
-    // If there's a mon number desync, also download the previous page again
-    if ((*current->data)["total_bundles"] != (*prev->data)["total_bundles"])
-    {
-        int prevPage = pageNumber - 1 == 0 ? pages() : pageNumber - 1;
-        downloadGroupPage(prev, prevPage, legal, low, high, LGPE);
-    }
-
-    return isGood;
-}
-
-bool GroupCloudAccess::prevPage()
-{
-    while (!prev->available)
-    {
-        usleep(100);
-    }
-    if (!prev->data || prev->data->is_discarded())
-    {
-        return isGood = false;
-    }
-    // Update data
-    pageNumber = pageNumber - 1 == 0 ? pages() : pageNumber - 1;
-    next       = current;
-    current    = prev;
-    prev       = std::make_shared<Page>();
-
-    // Download the next page in the background
-    int prevPage = pageNumber - 1 == 0 ? pages() : pageNumber - 1;
-    downloadGroupPage(prev, prevPage, legal, low, high, LGPE);
-
-    // If there's a mon number desync, also download the next page again
-    if ((*current->data)["total_bundles"] != (*next->data)["total_bundles"])
-    {
-        int nextPage = (pageNumber % pages()) + 1;
-        downloadGroupPage(next, nextPage, legal, low, high, LGPE);
-    }
-
-    return isGood;
-}
-
-int GroupCloudAccess::pages() const
-{
-    return (*current->data)["pages"].get<int>();
+    return Configuration::getInstance().gpssServer() + "/api/v1/gpss/bundles/all?count=" + std::to_string(NUM_GROUPS) +
+           "&min_gen=" + genToString(low) + "&max_gen=" + genToString(high) + "&lgpe=" + (LGPE ? std::string("yes") : std::string("no")) +
+           "&page=" + std::to_string(num) + (legal ? "&legal_only=yes" : "");
 }
 
 std::shared_ptr<PKX> GroupCloudAccess::pkm(size_t groupIndex, size_t pokeIndex) const
 {
-    if (groupIndex < (*current->data)["results"].size())
+    GPSSPage* data = collection.data();
+    if (data && groupIndex < data->groups() && pokeIndex < data->groupSize(groupIndex))
     {
-        auto& group = (*current->data)["results"][groupIndex];
-        if (pokeIndex < group["pokemon"].size())
+        if (auto ret = data->pokemon()[data->groupOffsets[groupIndex] + pokeIndex])
         {
-            auto& poke           = group["pokemon"][pokeIndex];
-            std::vector<u8> data = base64_decode(poke["base64"].get<std::string>());
-            Generation gen       = stringToGen(poke["generation"].get<std::string>());
-
-            auto ret = PKX::getPKM(gen, data.data(), data.size());
-            if (ret)
-            {
-                return ret;
-            }
+            return ret;
         }
     }
     return PKX::getPKM<Generation::SEVEN>(nullptr);
@@ -276,34 +89,25 @@ std::shared_ptr<PKX> GroupCloudAccess::pkm(size_t groupIndex, size_t pokeIndex)
 
 bool GroupCloudAccess::isLegal(size_t groupIndex, size_t pokeIndex) const
 {
-    if (groupIndex < (*current->data)["results"].size())
+    GPSSPage* data = collection.data();
+    if (data && groupIndex < data->groups() && pokeIndex < data->groupSize(groupIndex))
     {
-        auto& group = (*current->data)["results"][groupIndex];
-        if (pokeIndex < group["pokemon"].size())
-        {
-            return group["pokemon"][pokeIndex]["legal"];
-        }
+        return data->legal[data->groupOffsets[groupIndex] + pokeIndex];
     }
     return false;
 }
 
 std::shared_ptr<PKX> GroupCloudAccess::fetchPkm(size_t groupIndex, size_t pokeIndex) const
 {
-    if (groupIndex < (*current->data)["results"].size())
+    GPSSPage* data = collection.data();
+    if (data && groupIndex < data->groups() && pokeIndex < data->groupSize(groupIndex))
     {
-        auto& group = (*current->data)["results"][groupIndex];
-        if (pokeIndex < group["pokemon"].size())
-        {
-            auto& poke = group["pokemon"][pokeIndex];
-            auto ret   = pkm(groupIndex, pokeIndex);
+        // The cached one is shared with everything drawing this page, so hand out a copy that's safe to change
+        auto ret = pkm(groupIndex, pokeIndex)->clone();
 
-            if (auto fetch = Fetch::init("https://flagbrew.org/gpss/download/" + poke["code"].get<std::string>(), true, nullptr, nullptr, ""))
-            {
-                Fetch::performAsync(fetch);
-            }
+        DownloadCounter::pkm(data->codes[data->groupOffsets[groupIndex] + pokeIndex]);
 
-            return ret;
-        }
+        return ret;
     }
     return PKX::getPKM<Generation::SEVEN>(nullptr);
 }
@@ -311,12 +115,12 @@ std::shared_ptr<PKX> GroupCloudAccess::fetchPkm(size_t groupIndex, size_t pokeIn
 std::vector<std::shared_ptr<PKX>> GroupCloudAccess::group(size_t groupIndex) const
 {
     std::vector<std::shared_ptr<PKX>> ret;
-    if (groupIndex < (*current->data)["results"].size())
+    GPSSPage* data = collection.data();
+    if (data && groupIndex < data->groups())
     {
-        auto& group = (*current->data)["results"][groupIndex];
-        for (size_t i = 0; i < group["pokemon"].size(); i++)
+        for (size_t i = 0; i < data->groupSize(groupIndex); i++)
         {
-            ret.push_back(pkm(groupIndex, i));
+            ret.emplace_back(pkm(groupIndex, i));
         }
     }
     return ret;
@@ -325,18 +129,15 @@ std::vector<std::shared_ptr<PKX>> GroupCloudAccess::group(size_t groupIndex) con
 std::vector<std::shared_ptr<PKX>> GroupCloudAccess::fetchGroup(size_t groupIndex) const
 {
     std::vector<std::shared_ptr<PKX>> ret;
-    if (groupIndex < (*current->data)["results"].size())
+    GPSSPage* data = collection.data();
+    if (data && groupIndex < data->groups())
     {
-        auto& group = (*current->data)["results"][groupIndex];
-        for (size_t i = 0; i < group["pokemon"].size(); i++)
+        for (size_t i = 0; i < data->groupSize(groupIndex); i++)
         {
             // When the full group is downloaded, all the individual download counters will be incremented
-            ret.push_back(pkm(groupIndex, i));
-        }
-        if (auto fetch = Fetch::init("https://github.com/gpss/download/bundle/" + group["code"].get<std::string>(), true, nullptr, nullptr, ""))
-        {
-            Fetch::performAsync(fetch);
+            ret.emplace_back(pkm(groupIndex, i)->clone());
         }
+        DownloadCounter::bundle(data->groupCodes[groupIndex]);
     }
 
     return ret;
@@ -368,7 +169,7 @@ long GroupCloudAccess::group(std::vector<std::shared_ptr<PKX>> sendMe)
     }
 
     std::string writeData;
-    if (auto fetch = Fetch::init("https://flagbrew.org/gpss/share", true, &writeData, headers, ""))
+    if (auto fetch = Fetch::init(Configuration::getInstance().gpssServer() + "/gpss/share", true, &writeData, headers, ""))
     {
         auto mimeThing = fetch->mimeInit();
         for (size_t i = 0; i < sendMe.size(); i++)
@@ -387,7 +188,8 @@ long GroupCloudAccess::group(std::vector<std::shared_ptr<PKX>> sendMe)
             fetch->getinfo(CURLINFO_RESPONSE_CODE, &ret);
             if (ret == 201)
             {
-                refreshPages();
+                // Every page may have shifted
+                collection.reload();
             }
         }
     }
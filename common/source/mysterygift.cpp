@@ -1,6 +1,6 @@
 /*
  *   This file is part of PKSM
- *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
  *
  *   This program is free software: you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -25,155 +25,646 @@
  */
 
 #include "mysterygift.hpp"
+#include "GiftDB.hpp"
+#include "GiftDelta.hpp"
 #include "PGF.hpp"
 #include "PGT.hpp"
+#include "Sav.hpp"
 #include "WB7.hpp"
 #include "WC4.hpp"
 #include "WC6.hpp"
 #include "WC7.hpp"
 #include "io.hpp"
-#include "nlohmann/json.hpp"
+#include "thread.hpp"
 #include "utils.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <numeric>
+#include <sys/lock.h>
+#include <unistd.h>
+#include <unordered_map>
 
 namespace
 {
-    nlohmann::json mysteryGiftSheet = nlohmann::json::object();
-    u8* mysteryGiftData             = nullptr;
-}
+    Generation generation(GiftDB::CardType type)
+    {
+        switch (type)
+        {
+            case GiftDB::CardType::WC4:
+            case GiftDB::CardType::PGT:
+                return Generation::FOUR;
+            case GiftDB::CardType::PGF:
+                return Generation::FIVE;
+            case GiftDB::CardType::WC6:
+            case GiftDB::CardType::WC6FULL:
+                return Generation::SIX;
+            case GiftDB::CardType::WC7:
+            case GiftDB::CardType::WC7FULL:
+                return Generation::SEVEN;
+            case GiftDB::CardType::WB7:
+            case GiftDB::CardType::WB7FULL:
+                return Generation::LGPE;
+        }
+        return Generation::UNUSED;
+    }
 
-void MysteryGift::init(Generation g)
-{
-    // Just in case cleanup did not occur properly
-    mysteryGiftSheet.clear();
-    if (mysteryGiftData)
+    char lower(char c)
     {
-        delete[] mysteryGiftData;
-        mysteryGiftData = nullptr;
+        return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
     }
 
-    std::string sheetPath = "/3ds/PKSM/mysterygift/sheet" + genToString(g) + ".json.bz2";
-    std::string dataPath  = "/3ds/PKSM/mysterygift/data" + genToString(g) + ".bin.bz2";
-    if (!io::exists(sheetPath) || !io::exists(dataPath))
+    u32 trigram(const char* str)
     {
-        sheetPath = "romfs:/mg/sheet" + genToString(g) + ".json.bz2";
-        dataPath  = "romfs:/mg/data" + genToString(g) + ".bin.bz2";
+        return u32(u8(lower(str[0]))) << 16 | u32(u8(lower(str[1]))) << 8 | u8(lower(str[2]));
     }
 
-    FILE* f = fopen(sheetPath.c_str(), "rb");
-    if (f != NULL)
+    bool containsText(const std::string& name, const std::string& text)
+    {
+        return std::search(name.begin(), name.end(), text.begin(), text.end(), [](char a, char b) { return lower(a) == lower(b); }) != name.end();
+    }
+
+    template <typename T>
+    size_t vectorMemory(const std::vector<T>& vector)
+    {
+        return vector.capacity() * sizeof(T);
+    }
+
+    template <typename Map>
+    size_t mapMemory(const Map& map)
+    {
+        // Roughly what a node and its bucket cost
+        size_t ret = map.size() * (sizeof(typename Map::value_type) + 3 * sizeof(void*));
+        for (auto& [key, list] : map)
+        {
+            ret += vectorMemory(list);
+        }
+        return ret;
+    }
+
+    // Posting lists of card indices, each sorted. Names are indexed by every three-byte sequence in them, so a search only has to check the
+    // names of cards that contain all of the search text's trigrams
+    class SearchIndex
+    {
+    public:
+        void build(const std::vector<MysteryGift::CardInfo>& cards, const GiftDB::Database& database)
+        {
+            std::vector<std::pair<u32, u32>> pairs;
+            for (u32 i = 0; i < cards.size(); i++)
+            {
+                const std::string& name = *cards[i].name;
+                for (size_t j = 0; j + 3 <= name.size(); j++)
+                {
+                    pairs.emplace_back(trigram(name.data() + j), i);
+                }
+                bySpecies[cards[i].species].push_back(i);
+                byGame[*cards[i].game].push_back(i);
+                byType[size_t(cards[i].type)].push_back(i);
+                byLang[cards[i].lang].push_back(i);
+            }
+            std::sort(pairs.begin(), pairs.end());
+            pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+            gramCards.reserve(pairs.size());
+            for (auto& [gram, card] : pairs)
+            {
+                if (grams.empty() || grams.back() != gram)
+                {
+                    grams.push_back(gram);
+                    gramStarts.push_back(gramCards.size());
+                }
+                gramCards.push_back(card);
+            }
+            gramStarts.push_back(gramCards.size());
+
+            cardEvents.assign(cards.size(), NO_EVENT);
+            for (u32 i = 0; i < database.matches(); i++)
+            {
+                for (u32 j = 0; j < database.match(i).count; j++)
+                {
+                    cardEvents[database.matchCard(i, j)] = i;
+                }
+            }
+        }
+
+        std::vector<size_t> search(const std::vector<MysteryGift::CardInfo>& cards, size_t events, const MysteryGift::Search& search)
+        {
+            // Typing one more letter only ever narrows things down, so the last search's cards are the place to start
+            bool narrowing = lastCards && search.species == last.species && search.game == last.game && search.type == last.type &&
+                             search.lang == last.lang && search.text.compare(0, last.text.size(), last.text) == 0;
+            std::vector<u32> found = narrowing ? std::move(*lastCards) : candidates(cards.size(), search);
+            if (!search.text.empty())
+            {
+                found.erase(std::remove_if(found.begin(), found.end(), [&](u32 card) { return !containsText(*cards[card].name, search.text); }),
+                    found.end());
+            }
+
+            std::vector<bool> matched(events);
+            for (u32 card : found)
+            {
+                if (cardEvents[card] != NO_EVENT)
+                {
+                    matched[cardEvents[card]] = true;
+                }
+            }
+            std::vector<size_t> ret;
+            for (size_t i = 0; i < matched.size(); i++)
+            {
+                if (matched[i])
+                {
+                    ret.push_back(i);
+                }
+            }
+
+            last      = search;
+            lastCards = std::move(found);
+            return ret;
+        }
+
+        size_t memory(void) const
+        {
+            size_t ret = vectorMemory(grams) + vectorMemory(gramStarts) + vectorMemory(gramCards) + mapMemory(bySpecies) + mapMemory(byGame) +
+                         mapMemory(byLang) + vectorMemory(cardEvents);
+            for (auto& list : byType)
+            {
+                ret += vectorMemory(list);
+            }
+            return ret + (lastCards ? vectorMemory(*lastCards) : 0);
+        }
+
+    private:
+        static constexpr u32 NO_EVENT = 0xFFFFFFFF;
+
+        struct Postings
+        {
+            const u32* first;
+            const u32* last;
+            size_t size() const { return last - first; }
+        };
+
+        static Postings postings(const std::vector<u32>& list) { return {list.data(), list.data() + list.size()}; }
+
+        template <typename Map, typename Key>
+        static Postings find(const Map& map, const Key& key)
+        {
+            auto found = map.find(key);
+            return found == map.end() ? Postings{nullptr, nullptr} : postings(found->second);
+        }
+
+        std::vector<u32> candidates(size_t cards, const MysteryGift::Search& search) const
+        {
+            std::vector<Postings> lists;
+            if (search.species)
+            {
+                lists.push_back(find(bySpecies, *search.species));
+            }
+            if (!search.game.empty())
+            {
+                lists.push_back(find(byGame, std::string_view(search.game)));
+            }
+            if (search.type)
+            {
+                lists.push_back(postings(byType[size_t(*search.type)]));
+            }
+            if (!search.lang.empty())
+            {
+                lists.push_back(find(byLang, std::string_view(search.lang)));
+            }
+            for (size_t i = 0; i + 3 <= search.text.size(); i++)
+            {
+                u32 wanted = trigram(search.text.data() + i);
+                auto gram  = std::lower_bound(grams.begin(), grams.end(), wanted);
+                if (gram == grams.end() || *gram != wanted)
+                {
+                    return {};
+                }
+                size_t index = gram - grams.begin();
+                lists.push_back({gramCards.data() + gramStarts[index], gramCards.data() + gramStarts[index + 1]});
+            }
+
+            std::vector<u32> ret;
+            if (lists.empty())
+            {
+                ret.resize(cards);
+                std::iota(ret.begin(), ret.end(), 0);
+                return ret;
+            }
+
+            // Smallest first keeps every intersection as cheap as it can be
+            std::sort(lists.begin(), lists.end(), [](const Postings& a, const Postings& b) { return a.size() < b.size(); });
+            ret.assign(lists[0].first, lists[0].last);
+            std::vector<u32> next;
+            for (size_t i = 1; i < lists.size() && !ret.empty(); i++)
+            {
+                next.clear();
+                std::set_intersection(ret.begin(), ret.end(), lists[i].first, lists[i].last, std::back_inserter(next));
+                ret.swap(next);
+            }
+            return ret;
+        }
+
+        // Distinct trigrams, sorted. The cards containing grams[i] are gramCards[gramStarts[i], gramStarts[i + 1])
+        std::vector<u32> grams;
+        std::vector<u32> gramStarts;
+        std::vector<u32> gramCards;
+        std::unordered_map<int, std::vector<u32>> bySpecies;
+        // Keys point into the interned strings
+        std::unordered_map<std::string_view, std::vector<u32>> byGame;
+        std::array<std::vector<u32>, size_t(GiftDB::CardType::WB7FULL) + 1> byType;
+        std::unordered_map<std::string_view, std::vector<u32>> byLang;
+        std::vector<u32> cardEvents;
+        MysteryGift::Search last;
+        std::optional<std::vector<u32>> lastCards;
+    };
+
+    // Everything loaded for one generation
+    struct Catalogue
     {
-        fseek(f, 0, SEEK_END);
-        size_t size          = ftell(f);
-        unsigned int destLen = 700 * 1024; // big enough
-        char* s              = new char[size];
-        char* d              = new char[destLen]();
-        rewind(f);
-        fread(s, 1, size, f);
+        Generation gen;
+        std::string sheetPath;
+        std::string dataPath;
+        GiftDB::Database database;
+        std::vector<MysteryGift::CardInfo> cards;
+        // Keyed by offset into the database's string pool. Nodes don't move, so the cards can point into it
+        std::unordered_map<u32, std::string> strings;
+        SearchIndex index;
+
+        const std::string* intern(u32 offset) { return &strings.try_emplace(offset, database.string(offset)).first->second; }
+
+        // Whether the downloads are still the ones this was loaded from
+        bool current(void) const { return database.from(GiftDB::source(sheetPath), GiftDB::source(dataPath)); }
 
-        int r = BZ2_bzBuffToBuffDecompress(d, &destLen, s, size, 0, 0);
-        if (r == BZ_OK)
+        size_t memory(void) const
         {
-            mysteryGiftSheet = nlohmann::json::parse(d);
+            size_t ret = database.memory() + vectorMemory(cards) + index.memory();
+            for (auto& [offset, str] : strings)
+            {
+                ret += sizeof(std::pair<const u32, std::string>) + 3 * sizeof(void*) + str.capacity();
+            }
+            return ret;
         }
+    };
 
-        delete[] s;
-        delete[] d;
+    // Where applyDelta puts the data it rebuilds. It's left uncompressed, as it's only ever read to convert it
+    std::string deltaPath(Generation g) { return "/3ds/PKSM/mysterygift/data" + genToString(g) + ".bin"; }
 
-        fclose(f);
+    // The downloaded pair if there is one, and the one that shipped with PKSM otherwise
+    void sources(Generation g, std::string& sheetPath, std::string& dataPath)
+    {
+        sheetPath = "/3ds/PKSM/mysterygift/sheet" + genToString(g) + ".json.bz2";
+        dataPath  = "/3ds/PKSM/mysterygift/data" + genToString(g) + ".bin.bz2";
+        if (!io::exists(dataPath))
+        {
+            dataPath = deltaPath(g);
+        }
+        if (!io::exists(sheetPath) || !io::exists(dataPath))
+        {
+            sheetPath = "romfs:/mg/sheet" + genToString(g) + ".json.bz2";
+            dataPath  = "romfs:/mg/data" + genToString(g) + ".bin.bz2";
+        }
     }
 
-    if (mysteryGiftSheet.is_discarded())
+    std::string databasePath(Generation g) { return "/3ds/PKSM/cache/gifts" + genToString(g) + ".db"; }
+
+    // Converts the pair sources() picked. Downloads that can't be converted are corrupt, so they're deleted along with their checksums,
+    // which makes the next update fetch them again, and the pair that shipped with PKSM is converted in their place
+    bool convert(Generation g, std::string& sheetPath, std::string& dataPath, const std::atomic<bool>* cancelled)
     {
-        mysteryGiftSheet            = nlohmann::json::object();
-        mysteryGiftSheet["gen"]     = "BAD";
-        mysteryGiftSheet["matches"] = nlohmann::json::array();
+        const std::string dbPath = databasePath(g);
+        if (GiftDB::convert(sheetPath, dataPath, dbPath, cancelled))
+        {
+            return true;
+        }
+        if ((cancelled && *cancelled) || sheetPath.rfind("romfs:", 0) == 0)
+        {
+            return false;
+        }
+
+        const std::string romfsSheet = "romfs:/mg/sheet" + genToString(g) + ".json.bz2";
+        const std::string romfsData  = "romfs:/mg/data" + genToString(g) + ".bin.bz2";
+        if (!GiftDB::convert(romfsSheet, romfsData, dbPath, cancelled))
+        {
+            return false;
+        }
+        for (const std::string& path : {"/3ds/PKSM/mysterygift/sheet" + genToString(g) + ".json.bz2",
+                 "/3ds/PKSM/mysterygift/data" + genToString(g) + ".bin.bz2", deltaPath(g)})
+        {
+            remove(path.c_str());
+            remove((path + ".sha").c_str());
+        }
+        sheetPath = romfsSheet;
+        dataPath  = romfsData;
+        return true;
     }
 
-    f = fopen(dataPath.c_str(), "rb");
-    if (f != NULL)
+    // Returns null only if it's cancelled. Otherwise, gifts that couldn't be loaded just leave it empty
+    std::unique_ptr<Catalogue> load(Generation g, const std::atomic<bool>* cancelled)
     {
-        fseek(f, 0, SEEK_END);
-        u32 size             = ftell(f);
-        unsigned int destLen = 800 * 1024;
-        char* s              = new char[size];
-        mysteryGiftData      = new u8[destLen]();
-        rewind(f);
-        fread(s, 1, size, f);
+        auto ret = std::make_unique<Catalogue>();
+        ret->gen = g;
+        sources(g, ret->sheetPath, ret->dataPath);
+
+        // The downloads are only converted when they change; every other time this is just reading the index
+        const std::string dbPath = databasePath(g);
+        if (!ret->database.open(dbPath) || !ret->current())
+        {
+            ret->database.close();
+            if (convert(g, ret->sheetPath, ret->dataPath, cancelled))
+            {
+                ret->database.open(dbPath);
+            }
+        }
+        if (cancelled && *cancelled)
+        {
+            return nullptr;
+        }
 
-        int r = BZ2_bzBuffToBuffDecompress((char*)mysteryGiftData, &destLen, s, size, 0, 0);
-        if (r != BZ_OK)
+        ret->cards.reserve(ret->database.cards());
+        for (size_t i = 0; i < ret->database.cards(); i++)
         {
-            // TODO
+            const GiftDB::Card& card = ret->database.card(i);
+            ret->cards.push_back({ret->intern(card.name), ret->intern(card.game), generation(card.type), card.type, card.species, card.form,
+                card.gender, card.lang()});
         }
+        ret->index.build(ret->cards, ret->database);
+        return ret;
+    }
 
-        delete[] s;
+    // Only touched by the main thread
+    std::unique_ptr<Catalogue> catalogue;
 
-        fclose(f);
+    _LOCK_T preloadMutex;
+    // Guarded by preloadMutex
+    std::optional<Generation> wanted;
+    std::unique_ptr<Catalogue> preloaded;
+    std::atomic<bool> running = false;
+    // Tells the preload thread that what it's loading isn't wanted anymore
+    std::atomic<bool> obsolete = false;
+
+    void preloadThread(void*)
+    {
+        __lock_acquire(preloadMutex);
+        while (wanted)
+        {
+            Generation gen = *wanted;
+            obsolete       = false;
+            __lock_release(preloadMutex);
+
+            std::unique_ptr<Catalogue> loaded = load(gen, &obsolete);
+
+            __lock_acquire(preloadMutex);
+            if (wanted == gen)
+            {
+                wanted = std::nullopt;
+                if (loaded && loaded->memory() <= MysteryGift::MEMORY_BUDGET)
+                {
+                    preloaded = std::move(loaded);
+                }
+            }
+        }
+        running = false;
+        __lock_release(preloadMutex);
+    }
+
+    // A slot is free when it's all zeroes, which is also how the save finds its first free one
+    bool giftSlotEmpty(Sav& save, int slot)
+    {
+        std::unique_ptr<WCX> wcx = save.mysteryGift(slot);
+        if (!wcx)
+        {
+            return false;
+        }
+        const u8* data = wcx->rawData();
+        return std::all_of(data, data + wcx->size(), [](u8 byte) { return byte == 0; });
     }
 }
 
-std::unique_ptr<WCX> MysteryGift::wondercard(size_t index)
+void MysteryGift::initPreloading(void)
 {
-    std::string gen = mysteryGiftSheet["gen"];
+    __lock_init(preloadMutex);
+}
 
-    auto entry = mysteryGiftSheet["wondercards"][index];
+void MysteryGift::exitPreloading(void)
+{
+    __lock_acquire(preloadMutex);
+    wanted   = std::nullopt;
+    obsolete = true;
+    preloaded.reset();
+    __lock_release(preloadMutex);
+    while (running)
+    {
+        usleep(10'000);
+    }
+    catalogue.reset();
+}
 
-    u32 offset = entry["offset"];
+void MysteryGift::preload(Generation gen)
+{
+    if (catalogue && catalogue->gen != gen)
+    {
+        catalogue.reset();
+    }
+    else if (catalogue)
+    {
+        return;
+    }
 
-    if (gen == "4")
+    __lock_acquire(preloadMutex);
+    if (!(preloaded && preloaded->gen == gen) && wanted != gen)
     {
-        std::unique_ptr<WCX> wc = nullptr;
-        if (entry["type"] == "wc4")
+        preloaded.reset();
+        wanted   = gen;
+        obsolete = true;
+        if (!running)
         {
-            wc = std::make_unique<WC4>(mysteryGiftData + offset);
+            running = Threads::create(preloadThread, nullptr, 32 * 1024, true);
         }
-        else
+    }
+    __lock_release(preloadMutex);
+}
+
+bool MysteryGift::refresh(Generation gen)
+{
+    std::string sheetPath, dataPath;
+    sources(gen, sheetPath, dataPath);
+    const std::string dbPath = databasePath(gen);
+
+    {
+        GiftDB::Database database;
+        if (database.open(dbPath) && database.from(GiftDB::source(sheetPath), GiftDB::source(dataPath)))
         {
-            wc = std::make_unique<PGT>(mysteryGiftData + offset);
+            return true;
         }
-        return wc;
     }
-    else if (gen == "5")
+    return convert(gen, sheetPath, dataPath, nullptr);
+}
+
+bool MysteryGift::applyDelta(Generation gen, const std::string& manifest, const u8* archiveHash, const std::string& cardsURL)
+{
+    if (!GiftDelta::apply(manifest, archiveHash, databasePath(gen), cardsURL, deltaPath(gen)))
+    {
+        return false;
+    }
+    // The archive it replaces would otherwise still be preferred
+    remove(("/3ds/PKSM/mysterygift/data" + genToString(gen) + ".bin.bz2").c_str());
+    return true;
+}
+
+void MysteryGift::init(Generation gen)
+{
+    if (catalogue && (catalogue->gen != gen || !catalogue->current()))
     {
-        PGF* pgf = new PGF(mysteryGiftData + offset);
-        return std::unique_ptr<WCX>(pgf);
+        catalogue.reset();
     }
-    else if (gen == "6")
+    if (catalogue)
     {
-        WC6* wc6 = new WC6(mysteryGiftData + offset, entry["type"].get<std::string>().find("full") != std::string::npos);
-        return std::unique_ptr<WCX>(wc6);
+        return;
     }
-    else if (gen == "7")
+
+    __lock_acquire(preloadMutex);
+    // The preload has a head start, so waiting for it is never slower than starting over
+    while (running && wanted == gen)
     {
-        WC7* wc7 = new WC7(mysteryGiftData + offset, entry["type"].get<std::string>().find("full") != std::string::npos);
-        return std::unique_ptr<WCX>(wc7);
+        __lock_release(preloadMutex);
+        usleep(10'000);
+        __lock_acquire(preloadMutex);
     }
-    else if (gen == "LGPE")
+    if (preloaded && preloaded->gen == gen)
     {
-        WB7* wb7 = new WB7(mysteryGiftData + offset, entry["type"].get<std::string>().find("full") != std::string::npos);
-        return std::unique_ptr<WCX>(wb7);
+        catalogue = std::move(preloaded);
     }
-    else
+    __lock_release(preloadMutex);
+
+    if (!catalogue || !catalogue->current())
+    {
+        catalogue = load(gen, nullptr);
+    }
+}
+
+std::unique_ptr<WCX> MysteryGift::wondercard(size_t card)
+{
+    std::vector<u8> data = catalogue->database.data(card);
+    if (data.empty())
     {
         return nullptr;
     }
+
+    GiftDB::CardType type = catalogue->cards[card].type;
+    switch (type)
+    {
+        case GiftDB::CardType::WC4:
+            return std::make_unique<WC4>(data.data());
+        case GiftDB::CardType::PGT:
+            return std::make_unique<PGT>(data.data());
+        case GiftDB::CardType::PGF:
+            return std::make_unique<PGF>(data.data());
+        case GiftDB::CardType::WC6:
+        case GiftDB::CardType::WC6FULL:
+            return std::make_unique<WC6>(data.data(), type == GiftDB::CardType::WC6FULL);
+        case GiftDB::CardType::WC7:
+        case GiftDB::CardType::WC7FULL:
+            return std::make_unique<WC7>(data.data(), type == GiftDB::CardType::WC7FULL);
+        case GiftDB::CardType::WB7:
+        case GiftDB::CardType::WB7FULL:
+            return std::make_unique<WB7>(data.data(), type == GiftDB::CardType::WB7FULL);
+    }
+    return nullptr;
+}
+
+size_t MysteryGift::inject(Sav& save, const std::vector<size_t>& cards)
+{
+    // emptyGiftLocation gives back the last slot when every one is taken, so it's only a place to start looking
+    int slot = save.emptyGiftLocation();
+    if (slot < 0 || size_t(slot) >= save.maxWondercards() || !giftSlotEmpty(save, slot))
+    {
+        return 0;
+    }
+
+    // Read in the order they're stored in, so that the SD card is read front to back once rather than seeking back and forth
+    std::vector<size_t> order;
+    order.reserve(cards.size());
+    for (size_t i = 0; i < cards.size(); i++)
+    {
+        if (cards[i] < catalogue->cards.size())
+        {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&cards](size_t a, size_t b) {
+        return catalogue->database.card(cards[a]).offset < catalogue->database.card(cards[b]).offset;
+    });
+    std::vector<std::unique_ptr<WCX>> decoded(cards.size());
+    for (size_t i : order)
+    {
+        decoded[i] = wondercard(cards[i]);
+    }
+
+    // Each card goes into the next free slot, in the order the cards were asked for, until there are none left
+    size_t written = 0;
+    for (auto& wcx : decoded)
+    {
+        if (!wcx || wcx->generation() != save.generation())
+        {
+            continue;
+        }
+        while (size_t(slot) < save.maxWondercards() && !giftSlotEmpty(save, slot))
+        {
+            slot++;
+        }
+        if (size_t(slot) >= save.maxWondercards())
+        {
+            break;
+        }
+        save.mysteryGift(*wcx, slot++);
+        written++;
+    }
+    return written;
 }
 
 void MysteryGift::exit(void)
 {
-    delete[] mysteryGiftData;
-    mysteryGiftData = nullptr;
-    mysteryGiftSheet.clear();
+    // Kept around, so that opening the injector again is instant, unless that would hold on to too much memory
+    if (catalogue && catalogue->memory() > MEMORY_BUDGET)
+    {
+        catalogue.reset();
+    }
+}
+
+size_t MysteryGift::wondercards()
+{
+    return catalogue ? catalogue->database.matches() : 0;
+}
+
+bool MysteryGift::hasLanguage(size_t event, std::string_view lang)
+{
+    for (size_t i = 0; i < catalogue->database.match(event).count; i++)
+    {
+        if (catalogue->cards[catalogue->database.matchCard(event, i)].lang == lang)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t MysteryGift::eventCard(size_t event, std::string_view lang)
+{
+    for (size_t i = 0; i < catalogue->database.match(event).count; i++)
+    {
+        if (catalogue->cards[catalogue->database.matchCard(event, i)].lang == lang)
+        {
+            return catalogue->database.matchCard(event, i);
+        }
+    }
+    return catalogue->database.matchCard(event, 0);
 }
 
-std::vector<nlohmann::json> MysteryGift::wondercards()
+std::vector<size_t> MysteryGift::search(const Search& search)
 {
-    return mysteryGiftSheet["matches"];
+    return catalogue ? catalogue->index.search(catalogue->cards, catalogue->database.matches(), search) : std::vector<size_t>{};
 }
 
-Sav::giftData MysteryGift::wondercardInfo(size_t index)
+const MysteryGift::CardInfo& MysteryGift::wondercardInfo(size_t card)
 {
-    nlohmann::json entry = mysteryGiftSheet["wondercards"][index];
-    Sav::giftData ret(entry["name"].get<std::string>(), entry["game"].get<std::string>(), entry["species"].get<int>(), entry["form"].get<int>());
-    return ret;
+    return catalogue->cards[card];
 }
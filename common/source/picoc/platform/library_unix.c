@@ -24,6 +24,7 @@ struct LibraryFunction UnixFunctions[] =
     { sav_inject_pkx,       "void sav_inject_pkx(char* data, enum Generation type, int box, int slot, int doTradeEdits);" },
     { sav_inject_wcx,       "void sav_inject_wcx(char* data, enum Generation type, int slot, int alternateFormat);" },
     { sav_wcx_free_slot,    "int sav_wcx_free_slot();" },
+    { sav_inject_gifts,     "int sav_inject_gifts(int* gifts, int count);" },
     { sav_get_value,        "int sav_get_value(enum SAV_Field field, ...);" },
     { sav_get_max,          "int sav_get_max(enum SAV_MaxField field, ...);" },
     { sav_get_string,       "char* sav_get_string(unsigned int offset, unsigned int codepoints);" },
@@ -35,6 +36,10 @@ struct LibraryFunction UnixFunctions[] =
     { bank_get_pkx,         "char* bank_get_pkx(enum Generation* type, int box, int slot);" },
     { bank_get_size,        "int bank_get_size();" },
     { bank_select,          "void bank_select();" },
+    // mystery gift database, in the save's generation
+    { gift_count,           "int gift_count();" },
+    { gift_name,            "char* gift_name(int gift);" },
+    { gift_id,              "int gift_id(int gift);" },
     // pkm
     { pkx_encrypt,          "void pkx_decrypt(char* data, enum Generation type, int isParty);" },
     { pkx_decrypt,          "void pkx_encrypt(char* data, enum Generation type, int isParty);" },
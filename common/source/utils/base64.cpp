@@ -104,5 +104,11 @@ std::string base64_encode(const char* data, size_t input_length)
         ret[out_index++] = encoding_table[(triple >> 0 * 6) & 0x3F];
     }
 
+    // The last group was encoded with zero octets; mark them as padding so decoding gives back input_length bytes
+    for (size_t i = 0; i < (3 - input_length % 3) % 3; i++)
+    {
+        ret[ret.size() - 1 - i] = '=';
+    }
+
     return ret;
 }
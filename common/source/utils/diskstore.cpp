@@ -0,0 +1,483 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#include "diskstore.hpp"
+#include "STDirectory.hpp"
+#include "thread.hpp"
+#include <algorithm>
+#include <stdio.h>
+#include <unistd.h>
+#include <unordered_set>
+
+std::string DiskStore::path(const std::string& key) const
+{
+    // FNV-1a; file names only need to be stable, not secure
+    u64 hash = 0xcbf29ce484222325;
+    for (char c : key)
+    {
+        hash ^= (u8)c;
+        hash *= 0x100000001b3;
+    }
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+    return dir + name;
+}
+
+void DiskStore::drop(std::unordered_map<std::string, Entry>::iterator entry)
+{
+    std::string key = entry->first;
+    remove(path(key).c_str());
+    totalSize -= entry->second.size;
+    entries.erase(entry);
+    journal({{"erase", key}});
+}
+
+void DiskStore::evict(void)
+{
+    while (totalSize > maxSize && !entries.empty())
+    {
+        auto oldest = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->second.lastUsed < oldest->second.lastUsed)
+            {
+                oldest = it;
+            }
+        }
+        drop(oldest);
+    }
+}
+
+void DiskStore::replay(const nlohmann::json& change)
+{
+    if (change.contains("erase") && change["erase"].is_string())
+    {
+        auto found = entries.find(change["erase"].get<std::string>());
+        if (found != entries.end())
+        {
+            totalSize -= found->second.size;
+            entries.erase(found);
+        }
+        return;
+    }
+    // clang-format off
+    if (!change.contains("put") || !change["put"].is_string() ||
+        !change.contains("size") || !change["size"].is_number_unsigned() ||
+        !change.contains("lastUsed") || !change["lastUsed"].is_number_unsigned() ||
+        !change.contains("meta") || !change["meta"].is_object())
+    // clang-format on
+    {
+        return;
+    }
+    Entry& entry = entries[change["put"].get<std::string>()];
+    totalSize -= entry.size;
+    entry.size     = change["size"].get<size_t>();
+    entry.lastUsed = change["lastUsed"].get<u64>();
+    entry.meta     = change["meta"];
+    useCounter     = std::max(useCounter, entry.lastUsed);
+    totalSize += entry.size;
+}
+
+void DiskStore::journal(const nlohmann::json& change)
+{
+    std::string line = change.dump() + "\n";
+    FILE* out        = fopen(journalPath.c_str(), "ab");
+    if (out)
+    {
+        fwrite(line.data(), 1, line.size(), out);
+        fclose(out);
+    }
+    if (++journalLines >= JOURNAL_LIMIT)
+    {
+        writeIndex();
+    }
+}
+
+void DiskStore::writeIndex(void)
+{
+    nlohmann::json index = nlohmann::json::object();
+    for (auto& [key, entry] : entries)
+    {
+        index[key] = {{"size", entry.size}, {"lastUsed", entry.lastUsed}, {"meta", entry.meta}};
+    }
+
+    // The journal only goes once the new index is in place, so there's always one or the other to go by
+    std::string data    = index.dump();
+    std::string tmpPath = indexPath + ".tmp";
+    FILE* out           = fopen(tmpPath.c_str(), "wb");
+    if (!out)
+    {
+        return;
+    }
+    bool written = fwrite(data.data(), 1, data.size(), out) == data.size();
+    written      = fclose(out) == 0 && written;
+    if (written)
+    {
+        remove(indexPath.c_str());
+    }
+    if (written && rename(tmpPath.c_str(), indexPath.c_str()) == 0)
+    {
+        remove(journalPath.c_str());
+        journalLines = 0;
+    }
+    else
+    {
+        remove(tmpPath.c_str());
+    }
+}
+
+void DiskStore::open(size_t maxSize)
+{
+    __lock_init(mutex);
+    this->maxSize = maxSize;
+
+    auto readFile = [](const std::string& path, std::string& data) {
+        FILE* in = fopen(path.c_str(), "rb");
+        if (!in)
+        {
+            return false;
+        }
+        fseek(in, 0, SEEK_END);
+        size_t size = ftell(in);
+        rewind(in);
+        data.resize(size);
+        data.resize(fread(data.data(), 1, size, in));
+        fclose(in);
+        return true;
+    };
+
+    std::string data;
+    // Left behind if PKSM was killed between writing a new index and putting it in place
+    if (!readFile(indexPath, data))
+    {
+        rename((indexPath + ".tmp").c_str(), indexPath.c_str());
+        readFile(indexPath, data);
+    }
+    nlohmann::json index = nlohmann::json::parse(data, nullptr, false);
+    if (index.is_object())
+    {
+        for (auto& [key, json] : index.items())
+        {
+            // clang-format off
+            if (!json.is_object() ||
+                !json.contains("size") || !json["size"].is_number_unsigned() ||
+                !json.contains("lastUsed") || !json["lastUsed"].is_number_unsigned() ||
+                !json.contains("meta") || !json["meta"].is_object())
+            // clang-format on
+            {
+                continue;
+            }
+            Entry& entry   = entries[key];
+            entry.size     = json["size"].get<size_t>();
+            entry.lastUsed = json["lastUsed"].get<u64>();
+            entry.meta     = std::move(json["meta"]);
+            useCounter     = std::max(useCounter, entry.lastUsed);
+            totalSize += entry.size;
+        }
+    }
+
+    // Changes since the index was last written. A line cut short by a crash doesn't parse and is skipped
+    if (readFile(journalPath, data))
+    {
+        for (size_t pos = 0; pos < data.size();)
+        {
+            size_t end = std::min(data.find('\n', pos), data.size());
+            nlohmann::json change = nlohmann::json::parse(data.begin() + pos, data.begin() + end, nullptr, false);
+            if (change.is_object())
+            {
+                replay(change);
+            }
+            pos = end + 1;
+        }
+    }
+
+    // Anything that neither knows about was being written when PKSM was killed
+    STDirectory directory(dir);
+    if (directory.good())
+    {
+        std::unordered_set<std::string> known;
+        for (auto& entry : entries)
+        {
+            known.insert(path(entry.first));
+        }
+        for (size_t i = 0; i < directory.count(); i++)
+        {
+            std::string file = dir + directory.item(i);
+            if (!directory.folder(i) && file != indexPath && file != journalPath && !known.count(file))
+            {
+                remove(file.c_str());
+            }
+        }
+    }
+
+    evict();
+    writeIndex();
+    opened        = true;
+    writing       = true;
+    writerRunning = Threads::create(writer, this, 8 * 1024, true);
+}
+
+void DiskStore::close(void)
+{
+    if (!opened)
+    {
+        return;
+    }
+
+    // The writer only stops once it's written everything queued
+    writing = false;
+    while (writerRunning)
+    {
+        usleep(1000);
+    }
+
+    __lock_acquire(mutex);
+    writeIndex();
+    opened = false;
+    entries.clear();
+    pending.clear();
+    totalSize = 0;
+    __lock_release(mutex);
+}
+
+void DiskStore::writer(void* arg)
+{
+    DiskStore* store = (DiskStore*)arg;
+    while (true)
+    {
+        std::string key;
+        std::shared_ptr<const Pending> next;
+        __lock_acquire(store->mutex);
+        if (!store->pending.empty())
+        {
+            key  = store->pending.begin()->first;
+            next = store->pending.begin()->second;
+        }
+        __lock_release(store->mutex);
+
+        if (next)
+        {
+            store->put(key, next->data.data(), next->data.size(), next->meta);
+            __lock_acquire(store->mutex);
+            // Unless another putLater replaced it in the meantime, or it was erased while it was being written
+            auto found = store->pending.find(key);
+            if (found != store->pending.end() && found->second == next)
+            {
+                store->pending.erase(found);
+            }
+            else if (found == store->pending.end())
+            {
+                auto written = store->entries.find(key);
+                if (written != store->entries.end())
+                {
+                    store->drop(written);
+                }
+            }
+            __lock_release(store->mutex);
+        }
+        else if (!store->writing)
+        {
+            break;
+        }
+        else
+        {
+            usleep(50'000);
+        }
+    }
+    store->writerRunning = false;
+}
+
+bool DiskStore::put(const std::string& key, const void* data, size_t size, const nlohmann::json& meta)
+{
+    // Too big to ever fit; don't throw everything else out for it
+    if (!opened || size > maxSize)
+    {
+        return false;
+    }
+
+    std::string file    = path(key);
+    std::string tmpFile = file + "." + std::to_string(++tmpCounter) + ".tmp";
+    FILE* out           = fopen(tmpFile.c_str(), "wb");
+    if (!out)
+    {
+        return false;
+    }
+    bool written = fwrite(data, 1, size, out) == size;
+    written      = fclose(out) == 0 && written;
+
+    __lock_acquire(mutex);
+    // Whatever was there is out of date either way
+    auto found = entries.find(key);
+    if (found != entries.end())
+    {
+        drop(found);
+    }
+    if (opened && written && rename(tmpFile.c_str(), file.c_str()) == 0)
+    {
+        Entry& entry   = entries[key];
+        entry.size     = size;
+        entry.lastUsed = ++useCounter;
+        entry.meta     = meta;
+        totalSize += size;
+        journal({{"put", key}, {"size", size}, {"lastUsed", entry.lastUsed}, {"meta", meta}});
+        evict();
+    }
+    else
+    {
+        remove(tmpFile.c_str());
+        written = false;
+    }
+    __lock_release(mutex);
+    return written;
+}
+
+bool DiskStore::putLater(const std::string& key, std::string data, const nlohmann::json& meta)
+{
+    if (!opened || data.size() > maxSize)
+    {
+        return false;
+    }
+    if (!writerRunning)
+    {
+        return put(key, data.data(), data.size(), meta);
+    }
+    auto write = std::make_shared<const Pending>(Pending{std::move(data), meta});
+    __lock_acquire(mutex);
+    pending[key] = std::move(write);
+    __lock_release(mutex);
+    return true;
+}
+
+bool DiskStore::get(const std::string& key, std::string& data, nlohmann::json* meta)
+{
+    if (!opened)
+    {
+        return false;
+    }
+
+    bool ret = false;
+    __lock_acquire(mutex);
+    auto queued = pending.find(key);
+    if (queued != pending.end())
+    {
+        data = queued->second->data;
+        if (meta)
+        {
+            *meta = queued->second->meta;
+        }
+        __lock_release(mutex);
+        return true;
+    }
+    auto found = entries.find(key);
+    if (found != entries.end())
+    {
+        FILE* in = fopen(path(key).c_str(), "rb");
+        if (in)
+        {
+            data.resize(found->second.size);
+            ret = fread(data.data(), 1, data.size(), in) == data.size();
+            fclose(in);
+        }
+        if (ret)
+        {
+            found->second.lastUsed = ++useCounter;
+            if (meta)
+            {
+                *meta = found->second.meta;
+            }
+        }
+        else
+        {
+            drop(found);
+        }
+    }
+    __lock_release(mutex);
+    return ret;
+}
+
+bool DiskStore::meta(const std::string& key, nlohmann::json& meta)
+{
+    if (!opened)
+    {
+        return false;
+    }
+    __lock_acquire(mutex);
+    auto queued = pending.find(key);
+    auto found  = entries.find(key);
+    bool ret    = queued != pending.end() || found != entries.end();
+    if (queued != pending.end())
+    {
+        meta = queued->second->meta;
+    }
+    else if (ret)
+    {
+        meta = found->second.meta;
+    }
+    __lock_release(mutex);
+    return ret;
+}
+
+bool DiskStore::contains(const std::string& key)
+{
+    if (!opened)
+    {
+        return false;
+    }
+    __lock_acquire(mutex);
+    bool ret = pending.count(key) != 0 || entries.count(key) != 0;
+    __lock_release(mutex);
+    return ret;
+}
+
+void DiskStore::erase(const std::string& key)
+{
+    if (!opened)
+    {
+        return;
+    }
+    __lock_acquire(mutex);
+    pending.erase(key);
+    auto found = entries.find(key);
+    if (found != entries.end())
+    {
+        drop(found);
+    }
+    __lock_release(mutex);
+}
+
+void DiskStore::forEach(const std::function<void(const std::string&, const nlohmann::json&, u64)>& f)
+{
+    if (!opened)
+    {
+        return;
+    }
+    __lock_acquire(mutex);
+    for (auto& [key, entry] : entries)
+    {
+        f(key, entry.meta, entry.lastUsed);
+    }
+    __lock_release(mutex);
+}
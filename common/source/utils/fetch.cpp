@@ -25,10 +25,15 @@
  */
 
 #include "fetch.hpp"
+#include "nlohmann/json.hpp"
+#include "sha256.h"
 #include "thread.hpp"
+#include <algorithm>
+#include <array>
 #include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -36,18 +41,31 @@ namespace
 {
     struct MultiFetchRecord
     {
-        MultiFetchRecord(std::shared_ptr<Fetch> fetch = nullptr, std::function<void(CURLcode, std::shared_ptr<Fetch>)> function = nullptr)
-            : fetch(fetch), function(function)
+        MultiFetchRecord(std::shared_ptr<Fetch> fetch = nullptr, std::function<void(CURLcode, std::shared_ptr<Fetch>)> function = nullptr,
+            Fetch::Priority priority = Fetch::Priority::INTERACTIVE, bool active = false)
+            : fetch(fetch), function(function), priority(priority), active(active)
         {
         }
         std::shared_ptr<Fetch> fetch;
         std::function<void(CURLcode, std::shared_ptr<Fetch>)> function;
+        Fetch::Priority priority;
+        // Whether it's been added to the multi handle yet
+        bool active;
+        bool paused = false;
     };
 
     constexpr int MAX_FILE_BUFFER_SIZE = 0x10000;
 
     std::atomic<bool> multiThreadInfo = false;
     std::vector<MultiFetchRecord> fetches;
+    // Indexed by Fetch::Priority. The pipe is narrow, so background traffic gets very little of it
+    std::array<size_t, size_t(Fetch::Priority::COUNT)> maxActive = {0, 2, 1};
+
+    // Ring buffer of the last METRICS_HISTORY finished requests
+    constexpr size_t METRICS_HISTORY = 64;
+    std::vector<Fetch::Metrics> metrics;
+    size_t metricsStart = 0;
+    _LOCK_T metricsMutex;
     _LOCK_T fetchesMutex;
     CURLM* multiHandle = nullptr;
     _LOCK_T multiHandleMutex;
@@ -59,6 +77,139 @@ namespace
         str->append(ptr, size * nmemb);
         return size * nmemb;
     }
+
+    struct DownloadState
+    {
+        FILE* file         = nullptr;
+        const char* path   = nullptr;
+        Fetch* fetch       = nullptr;
+        curl_off_t offset  = 0;
+        bool hashing       = false;
+        bool checkedStatus = false;
+        bool goodResponse  = false;
+        SHA256_CTX shaContext;
+        std::string etag;
+        std::string lastModified;
+        curl_xferinfo_callback progress = nullptr;
+        void* progressInfo              = nullptr;
+    };
+
+    size_t download_write_callback(char* ptr, size_t size, size_t nmemb, void* userdata)
+    {
+        DownloadState* state = (DownloadState*)userdata;
+        if (!state->checkedStatus)
+        {
+            state->checkedStatus = true;
+            long status_code;
+            state->fetch->getinfo(CURLINFO_RESPONSE_CODE, &status_code);
+            if (status_code == 200 && state->offset > 0)
+            {
+                // Range was ignored or the file changed, so the whole thing is coming again. Reopen by name: freopen without one
+                // doesn't reliably truncate on newlib
+                fclose(state->file);
+                state->file   = fopen(state->path, "wb");
+                state->offset = 0;
+                sha256_init(&state->shaContext);
+                if (!state->file)
+                {
+                    return 0;
+                }
+                setvbuf(state->file, nullptr, _IOFBF, MAX_FILE_BUFFER_SIZE);
+            }
+            else
+            {
+                fseek(state->file, 0, SEEK_END);
+            }
+            state->goodResponse = status_code == 200 || status_code == 206;
+        }
+
+        if (!state->goodResponse)
+        {
+            // Error pages don't belong in the file
+            return size * nmemb;
+        }
+
+        if (state->hashing)
+        {
+            sha256_update(&state->shaContext, (u8*)ptr, size * nmemb);
+        }
+        return fwrite(ptr, size, nmemb, state->file) * size;
+    }
+
+    size_t download_header_callback(char* buffer, size_t size, size_t nitems, void* userdata)
+    {
+        DownloadState* state = (DownloadState*)userdata;
+        std::string name, value;
+        if (size * nitems >= 5 && memcmp(buffer, "HTTP/", 5) == 0)
+        {
+            // New response (probably after a redirect), so forget anything from the old one
+            state->etag.clear();
+            state->lastModified.clear();
+        }
+        else if (Fetch::parseHeader(buffer, size * nitems, name, value))
+        {
+            if (name == "etag")
+            {
+                state->etag = value;
+            }
+            else if (name == "last-modified")
+            {
+                state->lastModified = value;
+            }
+        }
+        return size * nitems;
+    }
+
+    int download_progress_callback(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+    {
+        DownloadState* state = (DownloadState*)clientp;
+        // Report progress for the whole file, not just the part being fetched right now
+        curl_off_t offset = state->goodResponse ? state->offset : 0;
+        return state->progress(state->progressInfo, dltotal + offset, dlnow + offset, ultotal, ulnow);
+    }
+
+    nlohmann::json readDownloadMeta(const std::string& metaPath)
+    {
+        nlohmann::json ret;
+        FILE* in = fopen(metaPath.c_str(), "rb");
+        if (in)
+        {
+            fseek(in, 0, SEEK_END);
+            size_t size = ftell(in);
+            rewind(in);
+            std::string data(size, '\0');
+            fread(data.data(), 1, size, in);
+            fclose(in);
+            ret = nlohmann::json::parse(data, nullptr, false);
+        }
+        return ret;
+    }
+
+    void writeDownloadMeta(const std::string& metaPath, const std::string& url, const DownloadState& state)
+    {
+        nlohmann::json meta = nlohmann::json::object();
+        meta["url"]          = url;
+        meta["etag"]         = state.etag;
+        meta["lastModified"] = state.lastModified;
+        std::string data     = meta.dump();
+        FILE* out            = fopen(metaPath.c_str(), "wb");
+        if (out)
+        {
+            fwrite(data.data(), 1, data.size(), out);
+            fclose(out);
+        }
+    }
+
+    Result finishDownload(const std::string& partPath, const std::string& metaPath, const std::string& path)
+    {
+        remove(path.c_str());
+        if (rename(partPath.c_str(), path.c_str()) != 0)
+        {
+            return -errno;
+        }
+        remove(metaPath.c_str());
+        return 0;
+    }
 }
 
 std::shared_ptr<Fetch> Fetch::init(const std::string& url, bool ssl, std::string* writeData, struct curl_slist* headers, const std::string& postdata)
@@ -96,49 +247,180 @@ std::shared_ptr<Fetch> Fetch::init(const std::string& url, bool ssl, std::string
     return fetch;
 }
 
-Result Fetch::download(
-    const std::string& url, const std::string& path, const std::string& postData, curl_xferinfo_callback progress, void* progressInfo)
+Result Fetch::download(const std::string& url, const std::string& path, const std::string& postData, curl_xferinfo_callback progress,
+    void* progressInfo, const u8* sha256Hash)
 {
-    FILE* file = fopen(path.c_str(), "wb");
-    if (!file)
+    const std::string partPath = path + ".part";
+    const std::string metaPath = path + ".part.meta";
+
+    DownloadState state;
+    state.path         = partPath.c_str();
+    state.hashing      = sha256Hash != nullptr;
+    state.progress     = progress;
+    state.progressInfo = progressInfo;
+    sha256_init(&state.shaContext);
+
+    // Only plain GETs can be resumed; there's no telling what a POST would do with a Range header
+    if (postData.empty())
+    {
+        nlohmann::json meta = readDownloadMeta(metaPath);
+        if (meta.is_object() && meta.contains("url") && meta["url"].is_string() && meta["url"].get<std::string>() == url)
+        {
+            state.file = fopen(partPath.c_str(), "r+b");
+            if (state.file)
+            {
+                u8* buffer = new u8[MAX_FILE_BUFFER_SIZE];
+                size_t read;
+                while ((read = fread(buffer, 1, MAX_FILE_BUFFER_SIZE, state.file)) > 0)
+                {
+                    if (state.hashing)
+                    {
+                        sha256_update(&state.shaContext, buffer, read);
+                    }
+                    state.offset += read;
+                }
+                delete[] buffer;
+                if (meta.contains("etag") && meta["etag"].is_string())
+                {
+                    state.etag = meta["etag"].get<std::string>();
+                }
+                if (meta.contains("lastModified") && meta["lastModified"].is_string())
+                {
+                    state.lastModified = meta["lastModified"].get<std::string>();
+                }
+            }
+        }
+    }
+
+    if (!state.file)
+    {
+        state.file = fopen(partPath.c_str(), "wb");
+        if (!state.file)
+        {
+            return -errno;
+        }
+    }
+    else if (state.hashing && state.offset > 0)
+    {
+        // The previous attempt may have gotten everything but the rename
+        SHA256_CTX copy = state.shaContext;
+        u8 hash[SHA256_BLOCK_SIZE];
+        sha256_final(&copy, hash);
+        if (memcmp(hash, sha256Hash, SHA256_BLOCK_SIZE) == 0)
+        {
+            fclose(state.file);
+            return finishDownload(partPath, metaPath, path);
+        }
+    }
+
+    writeDownloadMeta(metaPath, url, state);
+
+    struct curl_slist* headers = nullptr;
+    if (state.offset > 0 && (!state.etag.empty() || !state.lastModified.empty()))
     {
-        return -errno;
+        // If the file changed on the server, this makes it send the whole new file instead of a mismatched range
+        headers = curl_slist_append(headers, ("If-Range: " + (state.etag.empty() ? state.lastModified : state.etag)).c_str());
     }
 
-    if (auto fetch = Fetch::init(url, url.substr(0, 5) == "https", nullptr, nullptr, postData))
+    if (auto fetch = Fetch::init(url, url.substr(0, 5) == "https", nullptr, headers, postData))
     {
-        setvbuf(file, nullptr, _IOFBF, MAX_FILE_BUFFER_SIZE);
-        fetch->setopt(CURLOPT_WRITEFUNCTION, fwrite);
-        fetch->setopt(CURLOPT_WRITEDATA, file);
+        state.fetch = fetch.get();
+        setvbuf(state.file, nullptr, _IOFBF, MAX_FILE_BUFFER_SIZE);
+        fetch->setopt(CURLOPT_WRITEFUNCTION, download_write_callback);
+        fetch->setopt(CURLOPT_WRITEDATA, &state);
+        fetch->setopt(CURLOPT_HEADERFUNCTION, download_header_callback);
+        fetch->setopt(CURLOPT_HEADERDATA, &state);
+        if (state.offset > 0)
+        {
+            fetch->setopt(CURLOPT_RESUME_FROM_LARGE, (curl_off_t)state.offset);
+        }
         if (progress)
         {
             fetch->setopt(CURLOPT_NOPROGRESS, 0L);
-            fetch->setopt(CURLOPT_XFERINFOFUNCTION, progress);
-            fetch->setopt(CURLOPT_XFERINFODATA, progressInfo);
+            fetch->setopt(CURLOPT_XFERINFOFUNCTION, download_progress_callback);
+            fetch->setopt(CURLOPT_XFERINFODATA, &state);
         }
 
         auto res = Fetch::perform(fetch);
 
-        fclose(file);
+        if (state.file)
+        {
+            fclose(state.file);
+        }
+        curl_slist_free_all(headers);
 
         if (res.index() == 0)
         {
-            remove(path.c_str());
             return -std::get<0>(res);
         }
         else if (std::get<1>(res) != CURLE_OK)
         {
-            remove(path.c_str());
+            // Keep the partial file and its metadata around so that the next attempt can pick up where this one left off. Only an
+            // HTTP error makes it useless; connection failures and timeouts that never got a response leave it as it was
+            if (state.checkedStatus && !state.goodResponse)
+            {
+                remove(partPath.c_str());
+                remove(metaPath.c_str());
+            }
+            else if (state.goodResponse)
+            {
+                writeDownloadMeta(metaPath, url, state);
+            }
             return -(std::get<1>(res) + 100);
         }
+
+        long status_code;
+        fetch->getinfo(CURLINFO_RESPONSE_CODE, &status_code);
+        if (status_code == 416 && state.offset > 0)
+        {
+            // The partial file is no use for whatever the server has now; start over
+            remove(partPath.c_str());
+            remove(metaPath.c_str());
+            return download(url, path, postData, progress, progressInfo, sha256Hash);
+        }
+        else if (status_code != 200 && status_code != 206)
+        {
+            remove(partPath.c_str());
+            remove(metaPath.c_str());
+            return -1;
+        }
+
+        if (state.hashing)
+        {
+            u8 hash[SHA256_BLOCK_SIZE];
+            sha256_final(&state.shaContext, hash);
+            if (memcmp(hash, sha256Hash, SHA256_BLOCK_SIZE) != 0)
+            {
+                remove(partPath.c_str());
+                remove(metaPath.c_str());
+                return -2;
+            }
+        }
+
+        return finishDownload(partPath, metaPath, path);
     }
     else
     {
-        fclose(file);
+        fclose(state.file);
+        curl_slist_free_all(headers);
         return -1;
     }
+}
 
-    return 0;
+bool Fetch::parseHeader(const char* data, size_t size, std::string& name, std::string& value)
+{
+    std::string header(data, size);
+    size_t colon = header.find(':');
+    if (colon == std::string::npos || (size >= 5 && header.compare(0, 5, "HTTP/") == 0))
+    {
+        return false;
+    }
+    name = header.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    value = header.substr(colon + 1);
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t\r\n") + 1);
+    return true;
 }
 
 std::unique_ptr<curl_mime, decltype(curl_mime_free)*> Fetch::mimeInit()
@@ -152,12 +434,13 @@ std::unique_ptr<curl_mime, decltype(curl_mime_free)*> Fetch::mimeInit()
 
 void Fetch::multiMainThread(void*)
 {
-    int lastActive = INT_MIN;
     while (multiThreadInfo)
     {
         CURLMcode mc;
         int active;
 
+        schedule();
+
         __lock_acquire(multiHandleMutex);
         mc = curl_multi_perform(multiHandle, &active);
         __lock_release(multiHandleMutex);
@@ -173,35 +456,31 @@ void Fetch::multiMainThread(void*)
             }
         }
 
-        if (active < lastActive)
+        int msgs;
+        __lock_acquire(multiHandleMutex);
+        auto msg = curl_multi_info_read(multiHandle, &msgs);
+        while (msg != nullptr)
         {
-            int msgs;
-            __lock_acquire(multiHandleMutex);
-            auto msg = curl_multi_info_read(multiHandle, &msgs);
-            while (msg != nullptr)
+            // Find the done handle
+            __lock_acquire(fetchesMutex);
+            auto it = std::find_if(
+                fetches.begin(), fetches.end(), [&msg](const MultiFetchRecord& record) { return record.fetch->curl.get() == msg->easy_handle; });
+            // And delete it
+            if (it != fetches.end())
             {
-                // Find the done handle
-                __lock_acquire(fetchesMutex);
-                auto it = std::find_if(
-                    fetches.begin(), fetches.end(), [&msg](const MultiFetchRecord& record) { return record.fetch->curl.get() == msg->easy_handle; });
-                // And delete it
-                if (it != fetches.end())
+                recordMetrics(it->fetch, msg->data.result, it->priority);
+                if (it->function)
                 {
-                    if (it->function)
-                    {
-                        it->function(msg->data.result, it->fetch);
-                    }
-                    curl_multi_remove_handle(multiHandle, it->fetch->curl.get());
-                    fetches.erase(it);
+                    it->function(msg->data.result, it->fetch);
                 }
-                __lock_release(fetchesMutex);
-
-                msg = curl_multi_info_read(multiHandle, &msgs);
+                curl_multi_remove_handle(multiHandle, it->fetch->curl.get());
+                fetches.erase(it);
             }
-            __lock_release(multiHandleMutex);
-        }
+            __lock_release(fetchesMutex);
 
-        lastActive = active;
+            msg = curl_multi_info_read(multiHandle, &msgs);
+        }
+        __lock_release(multiHandleMutex);
 
         // Terrible things have happened, but I don't know what to do
     }
@@ -209,9 +488,171 @@ void Fetch::multiMainThread(void*)
     multiThreadInfo = true;
 }
 
+void Fetch::schedule(void)
+{
+    std::array<size_t, size_t(Priority::COUNT)> activeCount{};
+
+    __lock_acquire(multiHandleMutex);
+    __lock_acquire(fetchesMutex);
+    for (auto& record : fetches)
+    {
+        if (record.active)
+        {
+            activeCount[size_t(record.priority)]++;
+        }
+    }
+
+    bool interactive = activeCount[size_t(Priority::INTERACTIVE)] > 0;
+    for (auto it = fetches.begin(); it != fetches.end();)
+    {
+        auto& record = *it;
+        size_t max   = maxActive[size_t(record.priority)];
+        if (record.active)
+        {
+            if (record.priority != Priority::INTERACTIVE && record.paused != interactive)
+            {
+                // Paused transfers aren't subject to the low speed limit, so this won't make them time out
+                curl_easy_pause(record.fetch->curl.get(), interactive ? CURLPAUSE_ALL : CURLPAUSE_CONT);
+                record.paused = interactive;
+            }
+        }
+        else if (!interactive && (max == 0 || activeCount[size_t(record.priority)] < max))
+        {
+            if (curl_multi_add_handle(multiHandle, record.fetch->curl.get()) == CURLM_OK)
+            {
+                record.active = true;
+                activeCount[size_t(record.priority)]++;
+            }
+            else
+            {
+                if (record.function)
+                {
+                    record.function(CURLE_FAILED_INIT, record.fetch);
+                }
+                it = fetches.erase(it);
+                continue;
+            }
+        }
+        ++it;
+    }
+    __lock_release(fetchesMutex);
+    __lock_release(multiHandleMutex);
+}
+
+void Fetch::maxConcurrent(Priority priority, size_t max)
+{
+    maxActive[size_t(priority)] = max;
+}
+
+void Fetch::recordMetrics(std::shared_ptr<Fetch> fetch, CURLcode result, Priority priority)
+{
+    Metrics record;
+    char* url     = nullptr;
+    long connects = 0;
+    fetch->getinfo(CURLINFO_EFFECTIVE_URL, &url);
+    record.url      = url ? url : "";
+    record.result   = result;
+    record.status   = 0;
+    record.priority = priority;
+    fetch->getinfo(CURLINFO_RESPONSE_CODE, &record.status);
+    fetch->getinfo(CURLINFO_NAMELOOKUP_TIME_T, &record.dns);
+    fetch->getinfo(CURLINFO_CONNECT_TIME_T, &record.connect);
+    fetch->getinfo(CURLINFO_APPCONNECT_TIME_T, &record.tls);
+    fetch->getinfo(CURLINFO_STARTTRANSFER_TIME_T, &record.firstByte);
+    fetch->getinfo(CURLINFO_TOTAL_TIME_T, &record.total);
+    fetch->getinfo(CURLINFO_SIZE_DOWNLOAD_T, &record.bytesDown);
+    fetch->getinfo(CURLINFO_SIZE_UPLOAD_T, &record.bytesUp);
+    fetch->getinfo(CURLINFO_NUM_CONNECTS, &connects);
+    record.reused = connects == 0;
+
+    __lock_acquire(metricsMutex);
+    if (metrics.size() < METRICS_HISTORY)
+    {
+        metrics.emplace_back(std::move(record));
+    }
+    else
+    {
+        metrics[metricsStart] = std::move(record);
+        metricsStart          = (metricsStart + 1) % METRICS_HISTORY;
+    }
+    __lock_release(metricsMutex);
+}
+
+std::vector<Fetch::Metrics> Fetch::recentMetrics(void)
+{
+    __lock_acquire(metricsMutex);
+    std::vector<Metrics> ret(metrics.begin() + metricsStart, metrics.end());
+    ret.insert(ret.end(), metrics.begin(), metrics.begin() + metricsStart);
+    __lock_release(metricsMutex);
+    return ret;
+}
+
+Fetch::Histogram Fetch::histogram(curl_off_t Metrics::*field)
+{
+    Histogram ret;
+    __lock_acquire(metricsMutex);
+    for (auto& record : metrics)
+    {
+        curl_off_t value = std::max(record.*field, (curl_off_t)0);
+        size_t bucket    = 0;
+        while (value > 0 && bucket < ret.buckets.size() - 1)
+        {
+            value >>= 1;
+            bucket++;
+        }
+        ret.buckets[bucket]++;
+        ret.count++;
+    }
+    __lock_release(metricsMutex);
+    return ret;
+}
+
+curl_off_t Fetch::Histogram::percentile(float fraction) const
+{
+    u32 needed = count * fraction;
+    u32 seen   = 0;
+    for (size_t i = 0; i < buckets.size(); i++)
+    {
+        seen += buckets[i];
+        if (seen > needed || seen == count)
+        {
+            return ((curl_off_t)1 << i) - 1;
+        }
+    }
+    return 0;
+}
+
+bool Fetch::dumpMetrics(const std::string& path)
+{
+    FILE* out = fopen(path.c_str(), "a");
+    if (!out)
+    {
+        return false;
+    }
+    auto records = recentMetrics();
+    fprintf(out, "status result prio reused dns_us connect_us tls_us ttfb_us total_us down_bytes up_bytes url\n");
+    for (auto& record : records)
+    {
+        fprintf(out, "%ld %d %d %d %lld %lld %lld %lld %lld %lld %lld %s\n", record.status, (int)record.result, (int)record.priority,
+            (int)record.reused, (long long)record.dns, (long long)record.connect, (long long)record.tls, (long long)record.firstByte,
+            (long long)record.total, (long long)record.bytesDown, (long long)record.bytesUp, record.url.c_str());
+    }
+    constexpr std::pair<const char*, curl_off_t Metrics::*> fields[] = {{"dns_us", &Metrics::dns}, {"connect_us", &Metrics::connect},
+        {"tls_us", &Metrics::tls}, {"ttfb_us", &Metrics::firstByte}, {"total_us", &Metrics::total}, {"down_bytes", &Metrics::bytesDown}};
+    for (auto& [name, field] : fields)
+    {
+        Histogram hist = histogram(field);
+        fprintf(out, "%s: p50 <= %lld, p90 <= %lld, p99 <= %lld\n", name, (long long)hist.percentile(0.5f), (long long)hist.percentile(0.9f),
+            (long long)hist.percentile(0.99f));
+    }
+    fclose(out);
+    return true;
+}
+
 Result Fetch::initMulti()
 {
     __lock_init(fetchesMutex);
+    __lock_init(metricsMutex);
     __lock_init(multiHandleMutex);
     multiHandle     = curl_multi_init();
     multiThreadInfo = true;
@@ -238,7 +679,10 @@ void Fetch::exitMulti()
         __lock_acquire(multiHandleMutex);
         for (auto& i : fetches)
         {
-            curl_multi_remove_handle(multiHandle, i.fetch->curl.get());
+            if (i.active)
+            {
+                curl_multi_remove_handle(multiHandle, i.fetch->curl.get());
+            }
         }
         fetches.clear();
         __lock_release(fetchesMutex);
@@ -249,20 +693,32 @@ void Fetch::exitMulti()
     }
 }
 
-CURLMcode Fetch::performAsync(std::shared_ptr<Fetch> fetch, std::function<void(CURLcode, std::shared_ptr<Fetch>)> onComplete)
+CURLMcode Fetch::performAsync(std::shared_ptr<Fetch> fetch, std::function<void(CURLcode, std::shared_ptr<Fetch>)> onComplete, Priority priority)
 {
     if (multiInitialized)
     {
-        __lock_acquire(multiHandleMutex);
-        CURLMcode res = curl_multi_add_handle(multiHandle, fetch->curl.get());
-        __lock_release(multiHandleMutex);
-        if (res == CURLM_OK)
+        if (priority == Priority::INTERACTIVE)
         {
+            // Never held back, so start it right away
+            __lock_acquire(multiHandleMutex);
+            CURLMcode res = curl_multi_add_handle(multiHandle, fetch->curl.get());
+            if (res == CURLM_OK)
+            {
+                __lock_acquire(fetchesMutex);
+                fetches.emplace_back(fetch, onComplete, priority, true);
+                __lock_release(fetchesMutex);
+            }
+            __lock_release(multiHandleMutex);
+            return res;
+        }
+        else
+        {
+            // The multi thread starts it when there's room
             __lock_acquire(fetchesMutex);
-            fetches.emplace_back(fetch, onComplete);
+            fetches.emplace_back(fetch, onComplete, priority, false);
             __lock_release(fetchesMutex);
+            return CURLM_OK;
         }
-        return res;
     }
     else
     {
@@ -270,6 +726,41 @@ CURLMcode Fetch::performAsync(std::shared_ptr<Fetch> fetch, std::function<void(C
     }
 }
 
+bool Fetch::cancel(std::shared_ptr<Fetch> fetch)
+{
+    if (!multiInitialized || !fetch)
+    {
+        return false;
+    }
+
+    std::function<void(CURLcode, std::shared_ptr<Fetch>)> function;
+    bool found = false;
+    __lock_acquire(multiHandleMutex);
+    __lock_acquire(fetchesMutex);
+    for (auto it = fetches.begin(); it != fetches.end(); ++it)
+    {
+        if (it->fetch == fetch)
+        {
+            if (it->active)
+            {
+                curl_multi_remove_handle(multiHandle, fetch->curl.get());
+            }
+            function = std::move(it->function);
+            fetches.erase(it);
+            found = true;
+            break;
+        }
+    }
+    __lock_release(fetchesMutex);
+    __lock_release(multiHandleMutex);
+
+    if (function)
+    {
+        function(CURLE_ABORTED_BY_CALLBACK, fetch);
+    }
+    return found;
+}
+
 std::variant<CURLMcode, CURLcode> Fetch::perform(std::shared_ptr<Fetch> fetch)
 {
     if (multiInitialized)
@@ -0,0 +1,227 @@
+/*
+ *   This file is part of PKSM
+ *   Copyright (C) 2016-2020 Bernardo Giordano, Admiral Fish, piepie62, Allen Lydiard
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *   Additional Terms 7.b and 7.c of GPLv3 apply to this file:
+ *       * Requiring preservation of specified reasonable legal notices or
+ *         author attributions in that material or in the Appropriate Legal
+ *         Notices displayed by works containing it.
+ *       * Prohibiting misrepresentation of the origin of that material,
+ *         or requiring that modified versions of such material be marked in
+ *         reasonable ways as different from the original version.
+ */
+
+#include "httpcache.hpp"
+#include "diskstore.hpp"
+#include <string.h>
+
+namespace
+{
+    struct CacheRequest
+    {
+        std::string url;
+        std::string body;
+        std::string etag;
+        std::string lastModified;
+        struct curl_slist* headers = nullptr;
+        ~CacheRequest() { curl_slist_free_all(headers); }
+    };
+
+    DiskStore store("/3ds/PKSM/cache/http/");
+
+    // Cached validators, or false if there's nothing cached for the URL
+    bool validators(const std::string& url, std::string& etag, std::string& lastModified)
+    {
+        nlohmann::json meta;
+        if (!store.meta(url, meta))
+        {
+            return false;
+        }
+        if (meta.contains("etag") && meta["etag"].is_string())
+        {
+            etag = meta["etag"].get<std::string>();
+        }
+        if (meta.contains("lastModified") && meta["lastModified"].is_string())
+        {
+            lastModified = meta["lastModified"].get<std::string>();
+        }
+        return true;
+    }
+
+    size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata)
+    {
+        CacheRequest* request = (CacheRequest*)userdata;
+        std::string name, value;
+        if (size * nitems >= 5 && memcmp(buffer, "HTTP/", 5) == 0)
+        {
+            // New response (probably after a redirect), so forget anything from the old one
+            request->etag.clear();
+            request->lastModified.clear();
+        }
+        else if (Fetch::parseHeader(buffer, size * nitems, name, value))
+        {
+            if (name == "etag")
+            {
+                request->etag = value;
+            }
+            else if (name == "last-modified")
+            {
+                request->lastModified = value;
+            }
+        }
+        return size * nitems;
+    }
+
+    std::shared_ptr<Fetch> makeRequest(std::shared_ptr<CacheRequest> request, bool conditional)
+    {
+        std::string etag, lastModified;
+        if (conditional && validators(request->url, etag, lastModified))
+        {
+            if (!etag.empty())
+            {
+                request->headers = curl_slist_append(request->headers, ("If-None-Match: " + etag).c_str());
+            }
+            if (!lastModified.empty())
+            {
+                request->headers = curl_slist_append(request->headers, ("If-Modified-Since: " + lastModified).c_str());
+            }
+        }
+
+        auto fetch = Fetch::init(request->url, true, &request->body, request->headers, "");
+        if (fetch)
+        {
+            fetch->setopt(CURLOPT_HEADERFUNCTION, header_callback);
+            fetch->setopt(CURLOPT_HEADERDATA, request.get());
+        }
+        return fetch;
+    }
+
+    // Turns a finished request into what the caller should see, updating the cache along the way
+    long finish(std::shared_ptr<CacheRequest> request, CURLcode code, std::shared_ptr<Fetch> fetch, bool& changed)
+    {
+        changed = false;
+        if (code != CURLE_OK)
+        {
+            return 0;
+        }
+        long status_code;
+        fetch->getinfo(CURLINFO_RESPONSE_CODE, &status_code);
+        if (!store.isOpen())
+        {
+            changed = status_code == 200;
+            return status_code;
+        }
+        if (status_code == 304)
+        {
+            // If the body went missing, a 304 is of no use to anyone. The store has already dropped the entry in that case
+            return store.get(request->url, request->body) ? 200 : 0;
+        }
+        else if (status_code == 200)
+        {
+            changed = true;
+            // This runs in a Fetch callback, where writing to the SD card would hold up every other transfer
+            store.putLater(request->url, request->body, {{"etag", request->etag}, {"lastModified", request->lastModified}});
+        }
+        return status_code;
+    }
+}
+
+void HttpCache::init(size_t maxSize)
+{
+    store.open(maxSize);
+}
+
+void HttpCache::exit(void)
+{
+    store.close();
+}
+
+long HttpCache::get(const std::string& url, std::string& body)
+{
+    auto request = std::make_shared<CacheRequest>();
+    request->url = url;
+    if (auto fetch = makeRequest(request, true))
+    {
+        auto res = Fetch::perform(fetch);
+        if (res.index() == 1)
+        {
+            bool changed;
+            long ret = finish(request, std::get<1>(res), fetch, changed);
+            if (ret == 0 && std::get<1>(res) == CURLE_OK)
+            {
+                // Conditional request went bad; try once more without the cache
+                invalidate(url);
+                return get(url, body);
+            }
+            body = std::move(request->body);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+std::shared_ptr<Fetch> HttpCache::getAsync(
+    const std::string& url, std::function<void(long, std::string&)> onComplete, Fetch::Priority priority)
+{
+    auto request = std::make_shared<CacheRequest>();
+    request->url = url;
+    auto fetch   = makeRequest(request, true);
+    if (fetch && Fetch::performAsync(fetch, [request, onComplete](CURLcode code, std::shared_ptr<Fetch> fetch) {
+            bool changed;
+            long status = finish(request, code, fetch, changed);
+            if (onComplete)
+            {
+                onComplete(status, request->body);
+            }
+        }, priority) == CURLM_OK)
+    {
+        return fetch;
+    }
+    return nullptr;
+}
+
+bool HttpCache::getStale(const std::string& url, std::string& body, std::function<void(std::string&)> onRefresh)
+{
+    return peekStale(url, body, onRefresh) || get(url, body) == 200;
+}
+
+bool HttpCache::peekStale(const std::string& url, std::string& body, std::function<void(std::string&)> onRefresh)
+{
+    if (!store.get(url, body))
+    {
+        return false;
+    }
+
+    auto request = std::make_shared<CacheRequest>();
+    request->url = url;
+    if (auto fetch = makeRequest(request, true))
+    {
+        Fetch::performAsync(fetch, [request, onRefresh](CURLcode code, std::shared_ptr<Fetch> fetch) {
+            bool changed;
+            finish(request, code, fetch, changed);
+            if (changed && onRefresh)
+            {
+                onRefresh(request->body);
+            }
+        }, Fetch::Priority::PREFETCH);
+    }
+    return true;
+}
+
+void HttpCache::invalidate(const std::string& url)
+{
+    store.erase(url);
+}